@@ -0,0 +1,166 @@
+/**
+==================================
+
+Learning off the request thread (see LCS_Async.h).
+
+==================================
+*/
+
+#include "LCS_Async.h"
+
+using namespace LCS;
+
+// Learner polls this many times before sleeping between polls...
+
+static const int IDLE_SPINS = 64;
+static const int IDLE_MICROS = 20;
+
+/////////////////////////////////////// AsyncLearner Class:
+
+/**
+ * Constructor (model published as it is, then the learner starts - publishing as often as asked until it is gone):
+ */
+
+AsyncLearner::AsyncLearner(XCS& xcs, size_t capacity, Backpressure backpressure, unsigned long publish) :
+
+	_xcs(xcs),
+	_backpressure(backpressure),
+	_queue(capacity),
+	_reader(xcs.publisher()),
+	_random((uint64_t)now() ^ (uint64_t)(uintptr_t)this),
+	_action(0),
+	_enqueued(0),
+	_learned(0),
+	_dropped(0),
+	_lag(0),
+	_maxlag(0),
+	_stop(false),
+	_publishevery(xcs.publishingEvery())
+{
+	if (publish) _xcs.publishEvery(publish);
+	_xcs.publish();
+	_learner = thread(&AsyncLearner::work,this);
+}
+
+/**
+ * Destructor (the system publishing as it did before):
+ */
+
+AsyncLearner::~AsyncLearner() {
+
+	_stop.store(true);
+	_learner.join();
+	_xcs.publishEvery(_publishevery);
+}
+
+/**
+ * Act (best action of the latest model, or now and then any action):
+ */
+
+AsyncLearner::Action AsyncLearner::act(const Perception& state) {
+
+	const XCSModel& model = _reader.acquire();
+	_action = model.predict(state);
+	if (!model.actions().empty() && _random.uniform()<_xcs.EPSILON)
+		_action = model.actions()[_random.below(model.actions().size())];
+	_reader.release();
+
+	_percept = state;
+	return _action;
+}
+
+/**
+ * Update (queue the last act with its reward):
+ */
+
+bool AsyncLearner::update(Reward reward, bool done) {
+
+	return learn(_percept,_action,reward,done);
+}
+
+/**
+ * Learn (queue any experience - waiting for room, or dropping it):
+ */
+
+bool AsyncLearner::learn(const Perception& state, Action action, Reward reward, bool done) {
+
+	Experience* experience = _queue.back();
+	while (!experience) {
+		if (_backpressure==DROP) {
+			_dropped++;
+			return false;
+		}
+		this_thread::yield();
+		experience = _queue.back();
+	}
+
+	experience->percept = state;
+	experience->action = action;
+	experience->reward = reward;
+	experience->done = done;
+	experience->queued = now();
+	_queue.push();
+	_enqueued++;
+	return true;
+}
+
+/**
+ * Flush:
+ */
+
+void AsyncLearner::flush() {
+
+	while (_learned.load()<_enqueued.load())
+		this_thread::sleep_for(chrono::microseconds(IDLE_MICROS));
+}
+
+/**
+ * Stats:
+ */
+
+AsyncLearner::Stats AsyncLearner::stats() const {
+
+	Stats stats;
+	stats.depth = _queue.depth();
+	stats.capacity = _queue.capacity();
+	stats.enqueued = _enqueued.load();
+	stats.learned = _learned.load();
+	stats.dropped = _dropped.load();
+	stats.lag = _lag.load()*1e-9;
+	stats.maxlag = _maxlag.load()*1e-9;
+	stats.version = _xcs.publisher().version();
+	return stats;
+}
+
+/**
+ * Work (learner thread - until stopped and nothing is left):
+ */
+
+void AsyncLearner::work() {
+
+	int idle = 0;
+	while (true) {
+
+		Experience* experience = _queue.front();
+		if (!experience) {
+			if (_stop.load() && !_queue.front()) return;
+			if (++idle<IDLE_SPINS) this_thread::yield();
+			else this_thread::sleep_for(chrono::microseconds(IDLE_MICROS));
+			continue;
+		}
+		idle = 0;
+
+		_xcs.learn(experience->percept,experience->action,experience->reward,experience->done);
+
+		int64_t lag = now()-experience->queued;
+		_queue.pop();
+		_lag.store(lag);
+		if (lag>_maxlag.load()) _maxlag.store(lag);
+		_learned++;
+	}
+}
+
+int64_t AsyncLearner::now() {
+
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
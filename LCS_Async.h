@@ -0,0 +1,152 @@
+/**
+==================================
+
+Learning off the request thread.
+
+The thread serving requests acts from the latest model the system has
+published (exploring now and then), and hands each experience - perception,
+action taken and reward - to a queue. A learner thread of its own takes them
+off and learns (matching, covering, updates, GA and deletion), publishing
+a new model every so many steps. The request thread matched against a
+published model, whose classifiers are copies without the system's ids,
+so the learner matches the perception again - against the population as
+it is by then, which may have changed since the model was published.
+
+The queue has one producer and one consumer and never locks: acting and
+rewarding must stay on one thread at a time, and the system belongs to the
+learner until the async learner is gone.
+
+==================================
+*/
+
+// Inclusion guard:
+
+#ifndef __ASYNC__
+#define __ASYNC__
+
+#include "LCS_XCS.h"
+#include "LCS_Model.h"
+
+#include <thread>
+#include <atomic>
+
+////////////////////////////////////////////////////////////////
+// Queue and learner classes:
+
+namespace LCS {
+
+	/**
+	 * Single producer, single consumer ring of slots (reused, so no allocation once warm):
+	 */
+
+	template<class T> class SpscQueue {
+
+	public:
+
+		SpscQueue(size_t capacity) : _slots(max(capacity,(size_t)1)), _head(0), _tail(0) {}
+
+		size_t capacity() const { return _slots.size(); }
+		size_t depth() const { return _tail.load(memory_order_acquire) - _head.load(memory_order_acquire); }
+
+		// Producer - slot to fill (NULL when full), then push it...
+		T* back() {
+			size_t tail = _tail.load(memory_order_relaxed);
+			if (tail - _head.load(memory_order_acquire) >= _slots.size()) return NULL;
+			return &_slots[tail % _slots.size()];
+		}
+		void push() { _tail.store(_tail.load(memory_order_relaxed)+1,memory_order_release); }
+
+		// Consumer - slot to read (NULL when empty), then pop it...
+		T* front() {
+			size_t head = _head.load(memory_order_relaxed);
+			if (head == _tail.load(memory_order_acquire)) return NULL;
+			return &_slots[head % _slots.size()];
+		}
+		void pop() { _head.store(_head.load(memory_order_relaxed)+1,memory_order_release); }
+
+	private:
+
+		vector<T>			_slots;
+		alignas(64) atomic<size_t> _head;	// Consumer's (apart from the producer's)
+		alignas(64) atomic<size_t> _tail;
+	};
+
+	/**
+	 * Async learner:
+	 */
+
+	class AsyncLearner {
+
+	public:
+
+		typedef XCS::Perception Perception;
+		typedef XCS::Action		Action;
+		typedef XCS::Reward		Reward;
+
+		enum Backpressure {BLOCK=0,DROP};	// When the queue is full - wait for room, or drop the experience
+
+		struct Stats {
+
+			size_t			depth;			// Experiences waiting
+			size_t			capacity;
+			unsigned long	enqueued;
+			unsigned long	learned;
+			unsigned long	dropped;
+			double			lag;			// Seconds between queueing and learning (the last learned)
+			double			maxlag;
+			unsigned long	version;		// Models published
+		};
+
+	public:
+
+		AsyncLearner(XCS&, size_t capacity=4096, Backpressure=BLOCK, unsigned long publish=1000);	// Publish every so many steps (zero = as the system does)
+		~AsyncLearner();	// Learns whatever is still queued first
+
+		// Request thread...
+
+		Action act(const Perception&);	// From the latest model (exploring with the system's EPSILON)
+		bool update(Reward, bool done=true);	// For the last act (false if dropped - done as the system's multi-step update)
+		bool learn(const Perception&,Action,Reward,bool done=true);
+
+		void flush();		// Wait until everything queued is learned
+		Stats stats() const;
+
+	private:
+
+		AsyncLearner(const AsyncLearner&);
+		AsyncLearner& operator=(const AsyncLearner&);
+
+		struct Experience {
+
+			Perception	percept;
+			Action		action;
+			Reward		reward;
+			bool		done;		// End of the problem (multi-step)
+			int64_t		queued;		// Steady clock (nanoseconds)
+		};
+
+		void work();
+		static int64_t now();
+
+		XCS&						_xcs;
+		Backpressure				_backpressure;
+		SpscQueue<Experience>		_queue;
+		Publisher::Reader			_reader;
+		XCS::Random					_random;		// Exploration on the request thread
+		Perception					_percept;		// Last acted on
+		Action						_action;
+
+		atomic<unsigned long>		_enqueued;
+		atomic<unsigned long>		_learned;
+		atomic<unsigned long>		_dropped;
+		atomic<int64_t>				_lag;
+		atomic<int64_t>				_maxlag;
+		atomic<bool>				_stop;
+		unsigned long				_publishevery;	// The system's own (put back at the end)
+		thread						_learner;
+	};
+
+} // End namespace LCS
+
+
+#endif
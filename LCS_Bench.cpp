@@ -0,0 +1,623 @@
+/**
+==================================
+
+Throughput benchmarks for the eXtended Classifier System (XCS).
+
+Runs each problem at a fixed seed and reports, as JSON on stdout, the
+steps per second, act() latency percentiles, peak population and memory,
+and the learning curve (performance over the last window of steps).
+
+Build with:
+
+	g++ -O2 -pthread -o xcsbench LCS_Bench.cpp LCS_XCS.cpp LCS_Environment.cpp LCS_Model.cpp LCS_Threads.cpp
+
+Run all problems, or some, with:
+
+	./xcsbench [--steps N] [--seed S] [--problem mux6,parity6,...]
+
+Problems are multiplexers (mux6, mux11, mux20, mux37, mux70), even
+parity (parity6, parity11), a noisy eight action problem (noisy8), and
+multi-step mazes (woods1, maze4 - learning curves in steps to food).
+
+Or stress serving while learning - the learner runs flat out, publishing
+a model every so many steps, while reader threads predict from the latest
+and time every read:
+
+	./xcsbench --serve READERS [--publish STEPS] [--problem mux11] ...
+
+Or check that results do not depend on how they are computed - each check
+drives systems with the same stream and compares what they do (exits 1 if
+any differ):
+
+	./xcsbench --check [--steps N] [--problem mux6,...]
+
+Checks are index (the match index acts and learns exactly as the linear
+scan does), parallel (so does matching on four threads, once the
+population is large enough for them), snapshot (a system loaded from a
+snapshot goes on as the one saved), model (a compiled model predicts as
+the system does) and tickets (a ticket learns as updating the last act
+does, and is spent once rewarded or once its slot is used again).
+
+==================================
+*/
+
+#include "LCS_XCS.h"
+#include "LCS_Model.h"
+#include "LCS_Environment.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <atomic>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace LCS;
+
+////////////////////////////////////////////////////////////////
+// Problems:
+
+/**
+ * Random bits for perceptions (xorshift, so runs repeat exactly):
+ */
+
+class Bits {
+
+public:
+
+	Bits(unsigned long long seed) : _state(seed*2685821657736338717ULL+1) {}
+
+	int next() {
+		_state ^= _state >> 12;
+		_state ^= _state << 25;
+		_state ^= _state >> 27;
+		return (int)((_state*2685821657736338717ULL) >> 63);
+	}
+
+	double uniform() {
+		unsigned long long r = 0;
+		for (int b=0; b<53; b++) r = (r<<1) | next();
+		return r / 9007199254740992.0;
+	}
+
+private:
+
+	unsigned long long _state;
+};
+
+/**
+ * Problem definition - perception length, actions and correct action:
+ */
+
+struct Problem {
+
+	const char*	name;
+	int			bits;
+	int			actions;
+	long		steps;		// Default number of steps
+	int			kind;		// MUX, PARITY, NOISY or MAZE
+	int			address;	// Address bits (multiplexer)
+	double		noise;		// Probability correct action is replaced at random
+};
+
+enum {MUX,PARITY,NOISY,MAZE};
+
+static const Problem PROBLEMS[] = {
+	{"mux6",	6,	2,	20000,	MUX,	2,	0.0},
+	{"mux11",	11,	2,	20000,	MUX,	3,	0.0},
+	{"mux20",	20,	2,	20000,	MUX,	4,	0.0},
+	{"mux37",	37,	2,	10000,	MUX,	5,	0.0},
+	{"mux70",	70,	2,	5000,	MUX,	6,	0.0},
+	{"parity6",	6,	2,	20000,	PARITY,	0,	0.0},
+	{"parity11",11,	2,	20000,	PARITY,	0,	0.0},
+	{"noisy8",	6,	8,	20000,	NOISY,	3,	0.1},
+	{"woods1",	16,	8,	20000,	MAZE,	0,	0.0},
+	{"maze4",	16,	8,	50000,	MAZE,	0,	0.0},
+};
+
+static const int NPROBLEMS = sizeof(PROBLEMS)/sizeof(PROBLEMS[0]);
+
+/**
+ * Correct action for a perception:
+ */
+
+static int answer(const Problem& problem, const XCS::Perception& percept, Bits& random) {
+
+	switch (problem.kind) {
+
+		case MUX: {
+			int address = 0;
+			for (int b=0; b<problem.address; b++)
+				address = address*2 + percept[b];
+			return percept[problem.address+address];
+		}
+
+		case PARITY: {
+			int ones = 0;
+			for (int b=0; b<problem.bits; b++)
+				ones += percept[b];
+			return ones%2==0;
+		}
+
+		default: {
+			int label = 0;
+			for (int b=0; b<problem.address; b++)
+				label = label*2 + percept[b];
+			if (random.uniform() < problem.noise)
+				label = (int)(random.uniform()*problem.actions);
+			return label;
+		}
+	}
+}
+
+/**
+ * Peak resident memory so far (kilobytes):
+ */
+
+static long peakMemory() {
+
+#ifndef _WIN32
+	struct rusage usage;
+	getrusage(RUSAGE_SELF,&usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss/1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Percentile of sorted latencies:
+ */
+
+static double percentile(const vector<double>& sorted, double p) {
+
+	if (sorted.empty()) return 0.0;
+	size_t at = (size_t)(p*(sorted.size()-1) + 0.5);
+	return sorted[at];
+}
+
+////////////////////////////////////////////////////////////////
+// Benchmark:
+
+/**
+ * Run one problem and write its results:
+ */
+
+static void run(const Problem& problem, long steps, long seed, bool first) {
+
+	XCS::Actions actions;
+	for (int a=0; a<problem.actions; a++)
+		actions.push_back(a);
+
+	XCS xcs(actions);
+	xcs.seed(seed);
+	Bits random(seed);
+
+	// Learning curve sampled twenty times (performance over the last window)...
+	long window = max(steps/20,1L);
+	long correct = 0;
+	vector<pair<long,double> > curve;
+
+	vector<double> latency;
+	latency.reserve(steps);
+	long peak = 0;
+
+	XCS::Perception percept(problem.bits);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for (long step=1; step<=steps; step++) {
+
+		for (int b=0; b<problem.bits; b++)
+			percept[b] = random.next();
+		int right = answer(problem,percept,random);
+
+		chrono::steady_clock::time_point before = chrono::steady_clock::now();
+		XCS::Action act = xcs.act(percept);
+		latency.push_back(chrono::duration<double,nano>(chrono::steady_clock::now()-before).count());
+
+		if (act==right) correct++;
+		xcs.update(act==right ? 1000 : 0);
+
+		peak = max(peak,xcs.populationSize());
+		if (step%window==0) {
+			curve.push_back(make_pair(step,(double)correct/window));
+			correct = 0;
+		}
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+	sort(latency.begin(),latency.end());
+
+	// Write it (one object per problem)...
+	printf("%s\n    {\"problem\": \"%s\", \"bits\": %d, \"actions\": %d, \"steps\": %ld, \"seed\": %ld,\n",
+		first ? "" : ",",problem.name,problem.bits,problem.actions,steps,seed);
+	printf("     \"seconds\": %.6f, \"steps_per_sec\": %.1f,\n",seconds,steps/seconds);
+	printf("     \"act_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f},\n",
+		percentile(latency,0.5),percentile(latency,0.9),percentile(latency,0.99),percentile(latency,0.999),
+		latency.empty() ? 0.0 : latency.back());
+	printf("     \"population\": %ld, \"peak_population\": %ld, \"classifiers_allocated\": %lu, \"peak_rss_kb\": %ld,\n",
+		xcs.populationSize(),peak,xcs.classifiersAllocated(),peakMemory());
+	printf("     \"curve\": [");
+	for (size_t c=0; c<curve.size(); c++)
+		printf("%s[%ld, %.4f]",c ? ", " : "",curve[c].first,curve[c].second);
+	printf("]}");
+	fflush(stdout);
+}
+
+/**
+ * Run a maze (multi-step) and write its results:
+ */
+
+static void runMaze(const Problem& problem, long steps, long seed, bool first) {
+
+	XCS::Actions actions;
+	for (int a=0; a<problem.actions; a++)
+		actions.push_back(a);
+
+	XCS xcs(actions);
+	xcs.seed(seed);
+	xcs.multiStepOn();
+	Maze maze(problem.name,seed);
+
+	// Learning curve sampled twenty times (steps to food over the last window)...
+	long window = max(steps/20,1L);
+	unsigned long episodes = 0, moves = 0;
+	vector<pair<long,double> > curve;
+
+	vector<double> latency;
+	latency.reserve(steps);
+	long peak = 0;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for (long step=1; step<=steps; step++) {
+
+		const XCS::Perception& percept = maze.perceive();
+
+		chrono::steady_clock::time_point before = chrono::steady_clock::now();
+		XCS::Action act = xcs.act(percept);
+		latency.push_back(chrono::duration<double,nano>(chrono::steady_clock::now()-before).count());
+
+		XCS::Reward reward = maze.act(act);
+		xcs.update(reward,maze.done());
+
+		peak = max(peak,xcs.populationSize());
+		if (step%window==0) {
+			unsigned long solved = maze.episodes()-episodes;
+			curve.push_back(make_pair(step,solved ? (double)(maze.moves()-moves)/solved : 0.0));
+			episodes = maze.episodes();
+			moves = maze.moves();
+		}
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+	sort(latency.begin(),latency.end());
+
+	printf("%s\n    {\"problem\": \"%s\", \"bits\": %d, \"actions\": %d, \"steps\": %ld, \"seed\": %ld,\n",
+		first ? "" : ",",problem.name,problem.bits,problem.actions,steps,seed);
+	printf("     \"seconds\": %.6f, \"steps_per_sec\": %.1f, \"episodes\": %lu,\n",seconds,steps/seconds,maze.episodes());
+	printf("     \"act_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f},\n",
+		percentile(latency,0.5),percentile(latency,0.9),percentile(latency,0.99),percentile(latency,0.999),
+		latency.empty() ? 0.0 : latency.back());
+	printf("     \"population\": %ld, \"peak_population\": %ld, \"classifiers_allocated\": %lu, \"peak_rss_kb\": %ld,\n",
+		xcs.populationSize(),peak,xcs.classifiersAllocated(),peakMemory());
+	printf("     \"steps_to_food\": [");
+	for (size_t c=0; c<curve.size(); c++)
+		printf("%s[%ld, %.2f]",c ? ", " : "",curve[c].first,curve[c].second);
+	printf("]}");
+	fflush(stdout);
+}
+
+/**
+ * Serve one problem while learning it, and write the results:
+ */
+
+static void serve(const Problem& problem, long steps, long seed, int readers, long every, bool first) {
+
+	XCS::Actions actions;
+	for (int a=0; a<problem.actions; a++)
+		actions.push_back(a);
+
+	XCS xcs(actions);
+	xcs.seed(seed);
+	xcs.publishEvery(every);
+
+	// Readers predict random perceptions until learning is done...
+	atomic<bool> done(false);
+	vector<vector<double> > latency(readers);
+	vector<thread> threads;
+	for (int r=0; r<readers; r++) {
+		threads.push_back(thread([&,r]() {
+			Publisher::Reader reader(xcs.publisher());
+			Bits random(seed+1+r);
+			XCS::Perception percept(problem.bits);
+			while (!done.load()) {
+				for (int b=0; b<problem.bits; b++)
+					percept[b] = random.next();
+				chrono::steady_clock::time_point before = chrono::steady_clock::now();
+				reader.predict(percept);
+				latency[r].push_back(chrono::duration<double,nano>(chrono::steady_clock::now()-before).count());
+			}
+		}));
+	}
+
+	// Learner flat out...
+	Bits random(seed);
+	XCS::Perception percept(problem.bits);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (long step=1; step<=steps; step++) {
+		for (int b=0; b<problem.bits; b++)
+			percept[b] = random.next();
+		int right = answer(problem,percept,random);
+		xcs.update(xcs.act(percept)==right ? 1000 : 0);
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+
+	done.store(true);
+	for (size_t t=0; t<threads.size(); t++)
+		threads[t].join();
+
+	vector<double> reads;
+	for (int r=0; r<readers; r++)
+		reads.insert(reads.end(),latency[r].begin(),latency[r].end());
+	sort(reads.begin(),reads.end());
+
+	// Write it...
+	printf("%s\n    {\"problem\": \"%s\", \"readers\": %d, \"publish_every\": %ld, \"steps\": %ld, \"seed\": %ld,\n",
+		first ? "" : ",",problem.name,readers,every,steps,seed);
+	printf("     \"learner_seconds\": %.6f, \"learner_steps_per_sec\": %.1f, \"published\": %lu, \"retired_unreclaimed\": %lu,\n",
+		seconds,steps/seconds,xcs.publisher().version(),(unsigned long)xcs.publisher().retired());
+	printf("     \"reads\": %lu, \"reads_per_sec\": %.1f,\n",(unsigned long)reads.size(),reads.size()/seconds);
+	printf("     \"read_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f}}",
+		percentile(reads,0.5),percentile(reads,0.9),percentile(reads,0.99),percentile(reads,0.999),
+		reads.empty() ? 0.0 : reads.back());
+	fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////
+// Checks:
+
+/**
+ * Population as text (every classifier and its parameters):
+ */
+
+static string population(XCS& xcs) {
+
+	ostringstream text;
+	xcs.save(text);
+	return text.str();
+}
+
+/**
+ * Drive two systems with the same stream - same actions every step, and the same population at the end:
+ */
+
+static bool lockstep(XCS& one, XCS& other, const Problem& problem, long steps, Bits& random) {
+
+	XCS::Perception percept(problem.bits);
+	for (long step=1; step<=steps; step++) {
+		for (int b=0; b<problem.bits; b++)
+			percept[b] = random.next();
+		int right = answer(problem,percept,random);
+		XCS::Action act = one.act(percept);
+		if (other.act(percept)!=act) return false;
+		one.update(act==right ? 1000 : 0);
+		other.update(act==right ? 1000 : 0);
+	}
+	return population(one)==population(other);
+}
+
+/**
+ * Index - matching through the index, as by the linear scan:
+ */
+
+static bool checkIndex(const Problem& problem, const XCS::Actions& actions, long steps, long seed) {
+
+	XCS linear(actions), indexed(actions);
+	linear.seed(seed);
+	indexed.seed(seed);
+	indexed.matchIndexOn();
+
+	Bits random(seed);
+	return lockstep(linear,indexed,problem,steps,random);
+}
+
+/**
+ * Parallel - matching on threads, as on one (population let grow past where threads start, so they do):
+ */
+
+static bool checkParallel(const Problem& problem, const XCS::Actions& actions, long steps, long seed) {
+
+	XCS single(actions), threaded(actions);
+	single.seed(seed);
+	threaded.seed(seed);
+	single.N = threaded.N = 20000;
+	threaded.parallelMatchOn(4,0);
+
+	Bits random(seed);
+	return lockstep(single,threaded,problem,steps,random);
+}
+
+/**
+ * Snapshot - a system loaded from a snapshot halfway goes on exactly as the one saved (every
+ * parameter row, the generator and the sums restored):
+ */
+
+static bool checkSnapshot(const Problem& problem, const XCS::Actions& actions, long steps, long seed) {
+
+	XCS saved(actions), loaded(actions);
+	saved.seed(seed);
+	loaded.seed(seed+1); // Replaced by the snapshot's
+
+	Bits random(seed);
+	XCS::Perception percept(problem.bits);
+	for (long step=1; step<=steps/2; step++) {
+		for (int b=0; b<problem.bits; b++)
+			percept[b] = random.next();
+		int right = answer(problem,percept,random);
+		saved.update(saved.act(percept)==right ? 1000 : 0);
+	}
+
+	const char* path = "xcsbench-check.snapshot";
+	bool ok = saved.saveSnapshot(path) && loaded.loadSnapshot(path);
+	remove(path);
+
+	return ok && population(saved)==population(loaded) && lockstep(saved,loaded,problem,steps-steps/2,random);
+}
+
+/**
+ * Model - a compiled model predicts the same actions and values as the system it came from:
+ */
+
+static bool checkModel(const Problem& problem, const XCS::Actions& actions, long steps, long seed) {
+
+	XCS xcs(actions);
+	xcs.seed(seed);
+
+	Bits random(seed);
+	XCS::Perception percept(problem.bits);
+	for (long step=1; step<=steps; step++) {
+		for (int b=0; b<problem.bits; b++)
+			percept[b] = random.next();
+		int right = answer(problem,percept,random);
+		xcs.update(xcs.act(percept)==right ? 1000 : 0);
+	}
+
+	XCSModel model = xcs.compile();
+	for (long step=1; step<=steps; step++) {
+		for (int b=0; b<problem.bits; b++)
+			percept[b] = random.next();
+		double learned = 0.0, compiled = 0.0;
+		if (xcs.predict(percept,&learned)!=model.predict(percept,&compiled) || learned!=compiled) return false;
+	}
+	return true;
+}
+
+/**
+ * Tickets - rewarded at once, a ticket learns as updating the last act does, is spent once
+ * rewarded, and is spent too when its slot is used again (tickets run out at capacity):
+ */
+
+static bool checkTickets(const Problem& problem, const XCS::Actions& actions, long steps, long seed) {
+
+	XCS plain(actions), ticketed(actions);
+	plain.seed(seed);
+	ticketed.seed(seed);
+	ticketed.ticketCapacity(2);
+
+	Bits random(seed);
+	XCS::Perception percept(problem.bits);
+	XCS::Ticket ticket = 0;
+	for (long step=1; step<=steps; step++) {
+		for (int b=0; b<problem.bits; b++)
+			percept[b] = random.next();
+		int right = answer(problem,percept,random);
+		XCS::Action act = plain.act(percept);
+		if (ticketed.act(percept,ticket)!=act || ticket==0) return false;
+		plain.update(act==right ? 1000 : 0);
+		if (!ticketed.update(ticket,act==right ? 1000 : 0) || ticketed.update(ticket,0)) return false;
+	}
+	if (population(plain)!=population(ticketed)) return false;
+
+	XCS::Ticket first = 0, second = 0, third = 0;
+	ticketed.act(percept,first);
+	ticketed.act(percept,second);
+	ticketed.act(percept,third);
+	if (first==0 || second==0 || third!=0 || !ticketed.update(first,0)) return false;
+	ticketed.act(percept,third);
+	return third!=0 && third!=first && !ticketed.update(first,0) && ticketed.update(third,0) && ticketed.update(second,0);
+}
+
+/**
+ * Run the checks on one problem, and write their results:
+ */
+
+static bool check(const Problem& problem, long steps, long seed, bool first) {
+
+	XCS::Actions actions;
+	for (int a=0; a<problem.actions; a++)
+		actions.push_back(a);
+
+	struct { const char* name; bool (*run)(const Problem&,const XCS::Actions&,long,long); } checks[] = {
+		{"index",	checkIndex},
+		{"parallel",	checkParallel},
+		{"snapshot",	checkSnapshot},
+		{"model",	checkModel},
+		{"tickets",	checkTickets},
+	};
+
+	bool passed = true;
+	for (size_t c=0; c<sizeof(checks)/sizeof(checks[0]); c++) {
+		bool ok = checks[c].run(problem,actions,steps,seed);
+		printf("%s\n    {\"problem\": \"%s\", \"check\": \"%s\", \"steps\": %ld, \"seed\": %ld, \"ok\": %s}",
+			first && c==0 ? "" : ",",problem.name,checks[c].name,steps,seed,ok ? "true" : "false");
+		fflush(stdout);
+		passed = passed && ok;
+	}
+	return passed;
+}
+
+int main(int argc, char** argv) {
+
+	long steps = 0;		// Zero = problem default
+	long seed = 1;
+	int readers = 0;	// Zero = learning benchmarks (not serving)
+	long every = 1000;
+	bool checking = false;
+	string only;
+
+	for (int a=1; a<argc; a++) {
+		if (!strcmp(argv[a],"--steps") && a+1<argc) steps = atol(argv[++a]);
+		else if (!strcmp(argv[a],"--seed") && a+1<argc) seed = atol(argv[++a]);
+		else if (!strcmp(argv[a],"--problem") && a+1<argc) only = string(",") + argv[++a] + ",";
+		else if (!strcmp(argv[a],"--serve") && a+1<argc) readers = atoi(argv[++a]);
+		else if (!strcmp(argv[a],"--publish") && a+1<argc) every = atol(argv[++a]);
+		else if (!strcmp(argv[a],"--check")) checking = true;
+		else {
+			fprintf(stderr,"usage: %s [--steps N] [--seed S] [--problem name,...] [--serve READERS [--publish STEPS] | --check]\n",argv[0]);
+			return 1;
+		}
+	}
+
+	// Checks of single-step problems (a failure fails the run)...
+	if (checking) {
+		printf("{\"benchmark\": \"xcs-check\", \"results\": [");
+		bool passed = true, first = true;
+		for (int p=0; p<NPROBLEMS; p++) {
+			if (!only.empty() && only.find(string(",")+PROBLEMS[p].name+",")==string::npos) continue;
+			if (PROBLEMS[p].kind==MAZE) continue;
+			passed = check(PROBLEMS[p],steps ? steps : PROBLEMS[p].steps,seed,first) && passed;
+			first = false;
+		}
+		printf("\n]}\n");
+		return passed ? 0 : 1;
+	}
+
+	// Serving defaults to one problem...
+	if (readers>0 && only.empty()) only = ",mux11,";
+
+	printf("{\"benchmark\": \"%s\", \"results\": [",readers>0 ? "xcs-serve" : "xcs");
+	bool first = true;
+	for (int p=0; p<NPROBLEMS; p++) {
+		if (!only.empty() && only.find(string(",")+PROBLEMS[p].name+",")==string::npos) continue;
+		if (readers>0 && PROBLEMS[p].kind==MAZE) continue; // Serving is single-step only
+		if (readers>0)
+			serve(PROBLEMS[p],steps ? steps : PROBLEMS[p].steps,seed,readers,every,first);
+		else if (PROBLEMS[p].kind==MAZE)
+			runMaze(PROBLEMS[p],steps ? steps : PROBLEMS[p].steps,seed,first);
+		else
+			run(PROBLEMS[p],steps ? steps : PROBLEMS[p].steps,seed,first);
+		first = false;
+	}
+	printf("\n]}\n");
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+/**
+==================================
+
+Ensemble of classifier systems (see LCS_Ensemble.h).
+
+==================================
+*/
+
+#include "LCS_Ensemble.h"
+
+using namespace LCS;
+
+/////////////////////////////////////// XCSEnsemble Class:
+
+/**
+ * Constructor (members on independent streams of one seed):
+ */
+
+XCSEnsemble::XCSEnsemble(const Actions& actions, size_t members, long seed, size_t threads) :
+
+	_actions(actions),
+	_threads(threads ? threads : max(members,(size_t)1)),
+	_random(seed),
+	_reinforced(0),
+	_proposed(members),
+	_rewards(members),
+	_weighted(members),
+	_fitness(members)
+{
+	for (size_t m=0; m<members; m++) {
+		_members.push_back(new XCS(actions)); // ALLOC
+		_members[m]->seed(seed,m+1);
+	}
+}
+
+/**
+ * Destructor:
+ */
+
+XCSEnsemble::~XCSEnsemble() {
+
+	for (size_t m=0; m<_members.size(); m++)
+		delete _members[m]; // DEALLOC
+}
+
+/**
+ * Step (every member acts on the same perception, and learns from its own reward):
+ */
+
+bool XCSEnsemble::step(Environment& environment) {
+
+	if (environment.multiStep()) return false;
+
+	_percept = environment.perceive();
+
+	_threads.run(_members.size(),[&](size_t m) {
+		_proposed[m] = _members[m]->act(_percept);
+	});
+
+	// Rewards one by one (the environment is not shared)...
+	for (size_t m=0; m<_members.size(); m++) {
+		_rewards[m] = environment.act(_proposed[m]);
+		if (_rewards[m]>0) _reinforced++;
+	}
+
+	_threads.run(_members.size(),[&](size_t m) {
+		_members[m]->update(_rewards[m]);
+	});
+	return true;
+}
+
+/**
+ * Train (sampling as XCS::train does, population summed over members):
+ */
+
+bool XCSEnsemble::train(Environment& environment, unsigned long steps, unsigned long every, vector<double>* performance, vector<long>* population) {
+
+	if (environment.multiStep()) return false;
+
+	unsigned long reinforced = _reinforced;
+	for (unsigned long s=1; s<=steps; s++) {
+
+		step(environment);
+
+		if (every && s%every==0) {
+			if (performance) performance->push_back((double)(_reinforced-reinforced)/(every*max(_members.size(),(size_t)1)));
+			if (population) {
+				long size = 0;
+				for (size_t m=0; m<_members.size(); m++) size += _members[m]->populationSize();
+				population->push_back(size);
+			}
+			reinforced = _reinforced;
+		}
+	}
+	return true;
+}
+
+/**
+ * Fit (every member learns the same shuffle of rows, a task each per epoch):
+ */
+
+void XCSEnsemble::fit(const int* rows, const Action* labels, size_t n, size_t width, unsigned long epochs, Reward correct, Reward wrong, double* accuracy) {
+
+	fitRows(rows,labels,n,width,epochs,correct,wrong,accuracy);
+}
+
+void XCSEnsemble::fit(const unsigned char* rows, const Action* labels, size_t n, size_t width, unsigned long epochs, Reward correct, Reward wrong, double* accuracy) {
+
+	fitRows(rows,labels,n,width,epochs,correct,wrong,accuracy);
+}
+
+template<class F> void XCSEnsemble::fitRows(const F* rows, const Action* labels, size_t n, size_t width, unsigned long epochs, Reward correct, Reward wrong, double* accuracy) {
+
+	_order.resize(n);
+	for (size_t r=0; r<n; r++) _order[r] = r;
+	vector<size_t> right(_members.size());
+
+	for (unsigned long e=0; e<epochs; e++) {
+
+		// Shuffle (Fisher-Yates)...
+		for (size_t r=n; r>1; r--)
+			swap(_order[r-1],_order[_random.below(r)]);
+
+		_threads.run(_members.size(),[&](size_t m) {
+			Perception percept;
+			right[m] = 0;
+			for (size_t k=0; k<n; k++) {
+				size_t r = _order[k];
+				percept.assign(rows+r*width,rows+(r+1)*width);
+				bool hit = _members[m]->act(percept)==labels[r];
+				if (hit) right[m]++;
+				_members[m]->update(hit ? correct : wrong);
+			}
+		});
+
+		// Accuracy of members on average...
+		size_t hits = 0;
+		for (size_t m=0; m<_members.size(); m++) hits += right[m];
+		if (accuracy) accuracy[e] = n && !_members.empty() ? (double)hits/(n*_members.size()) : 0.0;
+	}
+}
+
+/**
+ * Predict:
+ */
+
+XCSEnsemble::Action XCSEnsemble::predict(const Perception& state, double* value) {
+
+	const size_t actions = _actions.size();
+	_threads.run(_members.size(),[&](size_t m) {
+		_weighted[m].assign(actions,0.0);
+		_fitness[m].assign(actions,0.0);
+		_members[m]->vote(state,_weighted[m].data(),_fitness[m].data());
+	});
+
+	return merge(0,value);
+}
+
+/**
+ * Batches (each member votes on every row, then rows are merged):
+ */
+
+void XCSEnsemble::predictBatch(const int* rows, size_t n, size_t width, Action* actions, double* values) {
+
+	predictRows(rows,n,width,actions,values);
+}
+
+void XCSEnsemble::predictBatch(const unsigned char* rows, size_t n, size_t width, Action* actions, double* values) {
+
+	predictRows(rows,n,width,actions,values);
+}
+
+template<class F> void XCSEnsemble::predictRows(const F* rows, size_t n, size_t width, Action* actions, double* values) {
+
+	const size_t count = _actions.size();
+	_threads.run(_members.size(),[&](size_t m) {
+		Perception percept;
+		_weighted[m].assign(n*count,0.0);
+		_fitness[m].assign(n*count,0.0);
+		for (size_t r=0; r<n; r++) {
+			percept.assign(rows+r*width,rows+(r+1)*width);
+			_members[m]->vote(percept,&_weighted[m][r*count],&_fitness[m][r*count]);
+		}
+	});
+
+	for (size_t r=0; r<n; r++)
+		actions[r] = merge(r,values ? values+r : NULL);
+}
+
+/**
+ * Merge (members' sums for a row, normalized, then the best as XCS::predict picks it):
+ */
+
+XCSEnsemble::Action XCSEnsemble::merge(size_t row, double* value) {
+
+	const size_t count = _actions.size();
+	Action best = _actions.empty() ? 0 : _actions[0];
+	double highest = 0.0;
+
+	for (size_t a=0; a<count; a++) {
+
+		double weighted = 0.0, fitness = 0.0;
+		for (size_t m=0; m<_members.size(); m++) {
+			weighted += _weighted[m][row*count+a];
+			fitness += _fitness[m][row*count+a];
+		}
+
+		double prediction = fitness!=0.0 ? weighted/fitness : 0.0;
+		if (prediction>highest) {
+			highest = prediction;
+			best = _actions[a];
+		}
+	}
+
+	if (value) *value = highest;
+	return best;
+}
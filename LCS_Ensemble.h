@@ -0,0 +1,91 @@
+/**
+==================================
+
+An ensemble of classifier systems - so many members seeded apart, learning
+from the same stream side by side, and deciding together.
+
+Members work on threads of their own pool (one task each), so a step or a
+decision takes about as long as it does for one member. Decisions merge the
+members' prediction arrays weighted by fitness, as if their populations
+were one.
+
+Learning from an environment asks it for a reward for every member's action
+on the same perception, so only single-step problems are learned from (a
+multi-step one would be moved once per member).
+
+==================================
+*/
+
+// Inclusion guard:
+
+#ifndef __ENSEMBLE__
+#define __ENSEMBLE__
+
+#include "LCS_XCS.h"
+#include "LCS_Environment.h"
+#include "LCS_Threads.h"
+
+////////////////////////////////////////////////////////////////
+// Ensemble class:
+
+namespace LCS {
+
+	class XCSEnsemble {
+
+	public:
+
+		typedef XCS::Perception Perception;
+		typedef XCS::Action		Action;
+		typedef XCS::Actions	Actions;
+		typedef XCS::Reward		Reward;
+
+	public:
+
+		XCSEnsemble(const Actions&, size_t members=5, long seed=1, size_t threads=0);	// Threads (zero = one per member)
+		~XCSEnsemble();
+
+		size_t size() const { return _members.size(); }
+		XCS& member(size_t m) { return *_members[m]; }
+
+		// Learning (performance is the fraction of members' actions rewarded)...
+
+		bool step(Environment&);	// False for multi-step problems (nothing learned)
+		bool train(Environment&,unsigned long,unsigned long every=0,vector<double>* performance=NULL,vector<long>* population=NULL);
+		void fit(const int*,const Action*,size_t,size_t,unsigned long,Reward,Reward,double* accuracy=NULL);
+		void fit(const unsigned char*,const Action*,size_t,size_t,unsigned long,Reward,Reward,double* accuracy=NULL);
+
+		// Decisions (exploit only)...
+
+		Action predict(const Perception&,double* value=NULL);
+		void predictBatch(const int*,size_t,size_t,Action*,double* values=NULL);
+		void predictBatch(const unsigned char*,size_t,size_t,Action*,double* values=NULL);
+
+	private:
+
+		XCSEnsemble(const XCSEnsemble&);
+		XCSEnsemble& operator=(const XCSEnsemble&);
+
+		template<class F> void fitRows(const F*,const Action*,size_t,size_t,unsigned long,Reward,Reward,double*);
+		template<class F> void predictRows(const F*,size_t,size_t,Action*,double*);
+		Action merge(size_t row,double*);
+
+		Actions					_actions;
+		vector<XCS*>			_members;
+		ThreadPool				_threads;
+		XCS::Random				_random;		// Shuffles rows for fit
+		vector<size_t>			_order;
+		unsigned long			_reinforced;	// Members' actions rewarded
+
+		// Scratch (a row per member)...
+
+		Perception				_percept;
+		vector<Action>			_proposed;
+		vector<Reward>			_rewards;
+		vector<vector<double> >	_weighted;		// Rows by actions
+		vector<vector<double> >	_fitness;
+	};
+
+} // End namespace LCS
+
+
+#endif
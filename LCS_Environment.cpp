@@ -0,0 +1,322 @@
+/**
+==================================
+
+Built-in environments (see LCS_Environment.h).
+
+==================================
+*/
+
+#include "LCS_Environment.h"
+
+using namespace LCS;
+
+/////////////////////////////////////// Multiplexer Class:
+
+/**
+ * Constructor:
+ */
+
+Multiplexer::Multiplexer(size_t address, long seed, Reward correct, Reward wrong) :
+
+	_address(address),
+	_correct(correct),
+	_wrong(wrong),
+	_random(seed),
+	_percept(address + ((size_t)1 << address))
+{
+}
+
+/**
+ * Perceive (random bits):
+ */
+
+const Environment::Perception& Multiplexer::perceive() {
+
+	for (size_t b=0; b<_percept.size(); b++)
+		_percept[b] = (int)(_random.next() >> 63);
+	return _percept;
+}
+
+/**
+ * Act:
+ */
+
+Environment::Reward Multiplexer::act(Action action) {
+
+	// Address picks the data bit...
+	size_t address = 0;
+	for (size_t b=0; b<_address; b++)
+		address = address*2 + _percept[b];
+
+	return action==_percept[_address+address] ? _correct : _wrong;
+}
+
+/**
+ * Clone:
+ */
+
+Environment* Multiplexer::clone(long seed) const {
+
+	return new Multiplexer(_address,seed,_correct,_wrong); // ALLOC - caller owns it
+}
+
+/////////////////////////////////////// Parity Class:
+
+/**
+ * Constructor:
+ */
+
+Parity::Parity(size_t bits, long seed, Reward correct, Reward wrong) :
+
+	_correct(correct),
+	_wrong(wrong),
+	_random(seed),
+	_percept(bits)
+{
+}
+
+/**
+ * Perceive (random bits):
+ */
+
+const Environment::Perception& Parity::perceive() {
+
+	for (size_t b=0; b<_percept.size(); b++)
+		_percept[b] = (int)(_random.next() >> 63);
+	return _percept;
+}
+
+/**
+ * Act:
+ */
+
+Environment::Reward Parity::act(Action action) {
+
+	long ones = 0;
+	for (size_t b=0; b<_percept.size(); b++)
+		ones += _percept[b];
+
+	return action==(ones%2==0) ? _correct : _wrong;
+}
+
+/**
+ * Clone:
+ */
+
+Environment* Parity::clone(long seed) const {
+
+	return new Parity(_percept.size(),seed,_correct,_wrong); // ALLOC - caller owns it
+}
+
+/////////////////////////////////////// Maze Class:
+
+// Built in layouts (Wilson's Woods1, and Lanzi's Maze4)...
+
+static const char* WOODS1 =
+	"....."
+	"\n.OOF."
+	"\n.OOO."
+	"\n.OOO."
+	"\n.....";
+
+static const char* MAZE4 =
+	"OOOOOOOO"
+	"\nO..O..FO"
+	"\nOO...OOO"
+	"\nO..O...O"
+	"\nO......O"
+	"\nOO...O.O"
+	"\nO....O.O"
+	"\nOOOOOOOO";
+
+// Directions of actions (north, then clockwise)...
+
+static const int DX[8] = {0,1,1,1,0,-1,-1,-1};
+static const int DY[8] = {-1,-1,0,1,1,1,0,-1};
+
+/**
+ * Constructor (parses the layout - with no empty cell, it is not valid):
+ */
+
+Maze::Maze(const string& layout, long seed, Reward food, size_t limit) :
+
+	_width(0),
+	_height(0),
+	_x(0),
+	_y(0),
+	_food(food),
+	_limit(limit),
+	_steps(0),
+	_done(true),
+	_episodes(0),
+	_moves(0),
+	_random(seed),
+	_percept(16,0)
+{
+	string rows = layout=="woods1" ? WOODS1 : layout=="maze4" ? MAZE4 : layout;
+
+	// Rows (all as wide as the first, short ones padded as empty)...
+	size_t start = 0;
+	while (start<=rows.size()) {
+		size_t end = rows.find('\n',start);
+		if (end==string::npos) end = rows.size();
+		string row = rows.substr(start,end-start);
+		if (!row.empty() && row[row.size()-1]=='\r') row.erase(row.size()-1);
+		if (!row.empty()) {
+			if (_width==0) _width = row.size();
+			row.resize(_width,'.');
+			_cells.insert(_cells.end(),row.begin(),row.end());
+			_height++;
+		}
+		start = end+1;
+	}
+
+	for (size_t c=0; c<_cells.size(); c++) {
+		if (_cells[c]=='Q') _cells[c] = 'O';
+		else if (_cells[c]=='G') _cells[c] = 'F';
+		else if (_cells[c]!='O' && _cells[c]!='F') _cells[c] = '.';
+		if (_cells[c]=='.') _empty.push_back(c);
+	}
+}
+
+/**
+ * Cell (wrapping around):
+ */
+
+char Maze::cell(long x, long y) const {
+
+	x = ((x % (long)_width) + _width) % _width;
+	y = ((y % (long)_height) + _height) % _height;
+	return _cells[y*_width+x];
+}
+
+/**
+ * Perceive (neighbours, starting afresh after the last problem ended):
+ */
+
+const Environment::Perception& Maze::perceive() {
+
+	if (_empty.empty()) return _percept;
+
+	if (_done) {
+		size_t c = _empty[_random.below(_empty.size())];
+		_x = c % _width;
+		_y = c / _width;
+		_steps = 0;
+		_done = false;
+	}
+
+	for (int d=0; d<8; d++) {
+		char c = cell(_x+DX[d],_y+DY[d]);
+		_percept[2*d] = c!='.';
+		_percept[2*d+1] = c=='F';
+	}
+	return _percept;
+}
+
+/**
+ * Act (move, unless into an obstacle):
+ */
+
+Environment::Reward Maze::act(Action action) {
+
+	if (_empty.empty() || _done) return 0;
+
+	int d = (int)(((action % 8) + 8) % 8);
+	char c = cell(_x+DX[d],_y+DY[d]);
+	if (c!='O') {
+		_x = (_x + DX[d] + _width) % _width;
+		_y = (_y + DY[d] + _height) % _height;
+	}
+	_steps++;
+
+	if (c=='F') {
+		_done = true;
+		_episodes++;
+		_moves += _steps;
+		return _food;
+	}
+
+	if (_limit && _steps>=_limit) _done = true;
+	return 0;
+}
+
+/**
+ * Clone:
+ */
+
+Environment* Maze::clone(long seed) const {
+
+	Maze* maze = new Maze(*this); // ALLOC - caller owns it
+	maze->_random.seed((uint64_t)seed);
+	maze->_done = true;
+	maze->_episodes = maze->_moves = 0;
+	return maze;
+}
+
+/////////////////////////////////////// Table Class:
+
+/**
+ * Constructors:
+ */
+
+Table::Table(const int* rows, const XCS::Action* labels, size_t n, size_t width, long seed, Reward correct, Reward wrong) :
+
+	_rows(rows,rows+n*width),
+	_labels(labels,labels+n),
+	_width(width),
+	_row(0),
+	_correct(correct),
+	_wrong(wrong),
+	_random(seed),
+	_percept(width)
+{
+}
+
+Table::Table(const unsigned char* rows, const XCS::Action* labels, size_t n, size_t width, long seed, Reward correct, Reward wrong) :
+
+	_rows(rows,rows+n*width),
+	_labels(labels,labels+n),
+	_width(width),
+	_row(0),
+	_correct(correct),
+	_wrong(wrong),
+	_random(seed),
+	_percept(width)
+{
+}
+
+/**
+ * Perceive (a row at random):
+ */
+
+const Environment::Perception& Table::perceive() {
+
+	if (_labels.empty()) return _percept;
+
+	_row = _random.below(_labels.size());
+	_percept.assign(_rows.begin()+_row*_width,_rows.begin()+(_row+1)*_width);
+	return _percept;
+}
+
+/**
+ * Act:
+ */
+
+Environment::Reward Table::act(Action action) {
+
+	if (_labels.empty()) return _wrong;
+
+	return action==_labels[_row] ? _correct : _wrong;
+}
+
+/**
+ * Clone (copies the rows):
+ */
+
+Environment* Table::clone(long seed) const {
+
+	Table* table = new Table(*this); // ALLOC - caller owns it
+	table->_random.seed((uint64_t)seed);
+	return table;
+}
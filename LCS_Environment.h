@@ -0,0 +1,178 @@
+/**
+==================================
+
+Environments for training a classifier system natively (no round trip to
+the caller for every step).
+
+An environment presents a perception, then pays a reward for the action
+taken in response to it. Multi-step problems (mazes) take many actions
+before they are done; single-step ones are done after every action.
+
+==================================
+*/
+
+// Inclusion guard:
+
+#ifndef __ENVIRONMENT__
+#define __ENVIRONMENT__
+
+#include "LCS_XCS.h"
+
+////////////////////////////////////////////////////////////////
+// Environment interface and built-in problems:
+
+namespace LCS {
+
+	class Environment {
+
+	public:
+
+		typedef XCS::Perception Perception;
+		typedef XCS::Action		Action;
+		typedef XCS::Reward		Reward;
+
+	public:
+
+		virtual ~Environment() {}
+
+		// Present the next perception...
+		virtual const Perception& perceive() = 0;
+
+		// Reward for the action taken on the last perception...
+		virtual Reward act(Action) = 0;
+
+		// End of the problem after the last action (always, for single-step problems)...
+		virtual bool done() const { return true; }
+
+		// Problems of more than one step (an action changes what is perceived next)...
+		virtual bool multiStep() const { return false; }
+
+		// Same problem drawing from another seed (for independent runs)...
+		virtual Environment* clone(long seed) const = 0;
+	};
+
+	/**
+	 * Multiplexer - address bits select one of the data bits, which is the answer:
+	 */
+
+	class Multiplexer : public Environment {
+
+	public:
+
+		Multiplexer(size_t address, long seed=1, Reward correct=1000, Reward wrong=0);
+
+		const Perception& perceive();
+		Reward act(Action);
+		Environment* clone(long) const;
+
+	private:
+
+		size_t			_address;
+		Reward			_correct;
+		Reward			_wrong;
+		XCS::Random		_random;
+		Perception		_percept;
+	};
+
+	/**
+	 * Even parity - the answer is 1 when an even number of bits are set:
+	 */
+
+	class Parity : public Environment {
+
+	public:
+
+		Parity(size_t bits, long seed=1, Reward correct=1000, Reward wrong=0);
+
+		const Perception& perceive();
+		Reward act(Action);
+		Environment* clone(long) const;
+
+	private:
+
+		Reward			_correct;
+		Reward			_wrong;
+		XCS::Random		_random;
+		Perception		_percept;
+	};
+
+	/**
+	 * Table - rows of a dataset drawn at random, the answer is the label of the row:
+	 */
+
+	class Table : public Environment {
+
+	public:
+
+		Table(const int* rows, const XCS::Action* labels, size_t n, size_t width, long seed=1, Reward correct=1000, Reward wrong=0);
+		Table(const unsigned char* rows, const XCS::Action* labels, size_t n, size_t width, long seed=1, Reward correct=1000, Reward wrong=0);
+
+		const Perception& perceive();
+		Reward act(Action);
+		Environment* clone(long) const;
+
+	private:
+
+		vector<XCS::Feature> _rows;		// Copied (row-major)
+		XCS::Actions	_labels;
+		size_t			_width;
+		size_t			_row;			// Row last presented
+		Reward			_correct;
+		Reward			_wrong;
+		XCS::Random		_random;
+		Perception		_percept;
+	};
+
+	/**
+	 * Maze - an animat moves between cells (eight directions) until it finds food:
+	 *
+	 * Layouts are rows of cells ('.' empty, 'O' or 'Q' obstacle, 'F' or 'G' food), which
+	 * wrap around at the edges (as woods do), or one built in - "woods1", "maze4". Each of
+	 * the eight neighbours (from north, clockwise) is seen as two bits - 00 empty, 10
+	 * obstacle, 11 food - and actions 0 to 7 move in those directions (into an obstacle
+	 * is no move). Finding food pays, and the next perception starts afresh on an empty
+	 * cell at random - as does running out of steps.
+	 */
+
+	class Maze : public Environment {
+
+	public:
+
+		Maze(const string& layout="woods1", long seed=1, Reward food=1000, size_t limit=50);
+
+		const Perception& perceive();
+		Reward act(Action);
+		bool done() const { return _done; }
+		bool multiStep() const { return true; }
+		Environment* clone(long) const;
+
+		// Problems solved, and the steps they took...
+		unsigned long episodes() const { return _episodes; }
+		unsigned long moves() const { return _moves; }
+		size_t width() const { return _width; }
+		size_t height() const { return _height; }
+		bool valid() const { return !_empty.empty(); }
+
+	private:
+
+		char cell(long x, long y) const;
+
+		vector<char>	_cells;		// Row-major
+		size_t			_width;
+		size_t			_height;
+		vector<size_t>	_empty;		// Cells to start from
+		size_t			_x, _y;
+		Reward			_food;
+		size_t			_limit;		// Steps before starting afresh (zero = no limit)
+		size_t			_steps;		// In this problem
+		bool			_done;
+		unsigned long	_episodes;
+		unsigned long	_moves;
+		XCS::Random		_random;
+		Perception		_percept;
+	};
+
+} // End namespace LCS
+
+
+#endif
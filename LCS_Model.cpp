@@ -0,0 +1,290 @@
+/**
+==================================
+
+Frozen classifier system (see LCS_Model.h).
+
+==================================
+*/
+
+#include "LCS_Model.h"
+
+using namespace LCS;
+
+// Words and actions handled on the stack (beyond that the heap)...
+
+static const size_t STACK_WORDS = 16;
+static const size_t STACK_ACTIONS = 64;
+
+/////////////////////////////////////// XCSModel Class:
+
+/**
+ * Constructors (empty, or compiled from the population of a system):
+ */
+
+XCSModel::XCSModel() :
+
+	_length(0),
+	_words(0)
+{
+}
+
+XCSModel::XCSModel(XCS& xcs) :
+
+	_length(0),
+	_words(0),
+	_actions(xcs._actions)
+{
+	// Longest condition sets the layout...
+	for (XCS::ClassifierIter cl = xcs._population.begin();cl!=xcs._population.end(); cl++)
+		_length = max(_length,(*cl)->_condition.size());
+	_words = (_length+63)/64;
+
+	// Rules for known actions only (others never win)...
+	for (XCS::ClassifierIter cl = xcs._population.begin();cl!=xcs._population.end(); cl++) {
+
+		const XCS::Classifier::Condition& condition = (*cl)->_condition;
+		if ((*cl)->_actionindex >= _actions.size()) continue;
+
+		for (size_t w=0; w<_words; w++) {
+			_care.push_back(w<condition.words() ? condition.care(w) : 0);
+			_value.push_back(w<condition.words() ? condition.value(w) : 0);
+		}
+		_actionindex.push_back((*cl)->_actionindex);
+		_weighted.push_back((*cl)->prediction() * (*cl)->fitness());
+		_fitness.push_back((*cl)->fitness());
+	}
+}
+
+/**
+ * Predict:
+ */
+
+XCSModel::Action XCSModel::predict(const Perception& state, double* value) const {
+
+	return predictRow(state.data(),state.size(),value);
+}
+
+/**
+ * Batches (one perception per row):
+ */
+
+void XCSModel::predictBatch(const int* rows, size_t n, size_t width, Action* actions, double* values) const {
+
+	for (size_t r=0; r<n; r++)
+		actions[r] = predictRow(rows+r*width,width,values ? values+r : NULL);
+}
+
+void XCSModel::predictBatch(const unsigned char* rows, size_t n, size_t width, Action* actions, double* values) const {
+
+	for (size_t r=0; r<n; r++)
+		actions[r] = predictRow(rows+r*width,width,values ? values+r : NULL);
+}
+
+/**
+ * Predict Row (packs it, on the stack when short enough):
+ */
+
+template<class F> XCSModel::Action XCSModel::predictRow(const F* row, size_t width, double* value) const {
+
+	size_t words = (width+63)/64;
+	Word stack[STACK_WORDS];
+	vector<Word> heap;
+	Word* bits = stack;
+	if (words>STACK_WORDS) {
+		heap.resize(words);
+		bits = heap.data();
+	}
+
+	for (size_t w=0; w<words; w++) bits[w] = 0;
+	for (size_t x=0; x<width; x++)
+		if (row[x]) bits[x>>6] |= (Word)1 << (x&63);
+
+	return best(bits,words,value);
+}
+
+/**
+ * Best (action with the highest fitness weighted prediction among matching rules):
+ */
+
+XCSModel::Action XCSModel::best(const Word* bits, size_t words, double* value) const {
+
+	const size_t actions = _actions.size();
+	double stack[2*STACK_ACTIONS];
+	vector<double> heap;
+	double* predictions = stack;
+	if (actions>STACK_ACTIONS) {
+		heap.resize(2*actions);
+		predictions = heap.data();
+	}
+	double* fitsums = predictions + actions;
+	for (size_t a=0; a<actions; a++) predictions[a] = fitsums[a] = 0.0;
+
+	// Compare only the words both have (as the system does)...
+	const size_t compare = min(words,_words);
+	const size_t rules = _actionindex.size();
+
+	if (compare==1) {
+		// Short conditions (one word each)...
+		const Word b = bits[0];
+		for (size_t r=0; r<rules; r++) {
+			if ((b ^ _value[r*_words]) & _care[r*_words]) continue;
+			predictions[_actionindex[r]] += _weighted[r];
+			fitsums[_actionindex[r]] += _fitness[r];
+		}
+	}
+	else {
+		for (size_t r=0; r<rules; r++) {
+			const Word* care = &_care[r*_words];
+			const Word* value = &_value[r*_words];
+			size_t w = 0;
+			while (w<compare && !((bits[w] ^ value[w]) & care[w])) w++;
+			if (w<compare) continue;
+			predictions[_actionindex[r]] += _weighted[r];
+			fitsums[_actionindex[r]] += _fitness[r];
+		}
+	}
+
+	// Normalize and pick...
+	Action best = _actions.empty() ? 0 : _actions[0];
+	double highest = 0.0;
+	for (size_t a=0; a<actions; a++) {
+		if (fitsums[a]!=0.0) predictions[a] = predictions[a]/fitsums[a];
+		if (predictions[a]>highest) {
+			highest = predictions[a];
+			best = _actions[a];
+		}
+	}
+
+	if (value) *value = highest;
+	return best;
+}
+
+/////////////////////////////////////// Publisher Class:
+
+/**
+ * Reader slot (a cache line each, so readers do not share):
+ */
+
+struct Publisher::Slot {
+
+	atomic<bool>		used;
+	atomic<uint64_t>	epoch;	// Epoch when the model in use was read (0 = none)
+	Slot*				next;
+	char				pad[64 - sizeof(atomic<bool>) - sizeof(atomic<uint64_t>) - sizeof(Slot*)];
+
+	Slot() : used(true), epoch(0), next(NULL) {}
+};
+
+/**
+ * Constructor:
+ */
+
+Publisher::Publisher() :
+
+	_model(NULL),
+	_epoch(1),
+	_version(0),
+	_slots(NULL)
+{
+}
+
+/**
+ * Destructor (no readers left by now):
+ */
+
+Publisher::~Publisher() {
+
+	delete _model.load();
+	for (size_t r=0; r<_retired.size(); r++)
+		delete _retired[r].first;
+
+	Slot* slot = _slots.load();
+	while (slot) {
+		Slot* next = slot->next;
+		delete slot;
+		slot = next;
+	}
+}
+
+/**
+ * Publish (swap in, then free replaced models no reader can still hold):
+ */
+
+void Publisher::publish(XCSModel* model) {
+
+	const XCSModel* old = _model.exchange(model);
+	uint64_t epoch = ++_epoch;
+	_version++;
+	if (old) _retired.push_back(make_pair(old,epoch));
+
+	// Oldest epoch any reader is in (readers since the swap only see new models)...
+	uint64_t oldest = epoch;
+	for (Slot* slot = _slots.load(); slot; slot = slot->next) {
+		uint64_t e = slot->epoch.load();
+		if (e && e<oldest) oldest = e;
+	}
+
+	size_t kept = 0;
+	for (size_t r=0; r<_retired.size(); r++) {
+		if (_retired[r].second<=oldest) delete _retired[r].first;
+		else _retired[kept++] = _retired[r];
+	}
+	_retired.resize(kept);
+}
+
+/**
+ * Reader constructor (a free slot, or a new one - never waits):
+ */
+
+Publisher::Reader::Reader(Publisher& publisher) :
+
+	_publisher(publisher),
+	_slot(NULL)
+{
+	for (Slot* slot = _publisher._slots.load(); slot && !_slot; slot = slot->next) {
+		bool free = false;
+		if (slot->used.compare_exchange_strong(free,true)) _slot = slot;
+	}
+
+	if (!_slot) {
+		_slot = new Slot();
+		_slot->next = _publisher._slots.load();
+		while (!_publisher._slots.compare_exchange_weak(_slot->next,_slot));
+	}
+}
+
+/**
+ * Reader destructor (slot back for others):
+ */
+
+Publisher::Reader::~Reader() {
+
+	_slot->epoch.store(0);
+	_slot->used.store(false);
+}
+
+/**
+ * Acquire (announce the epoch first, so the writer keeps what is read after):
+ */
+
+const XCSModel& Publisher::Reader::acquire() {
+
+	_slot->epoch.store(_publisher._epoch.load());
+	return *_publisher._model.load();
+}
+
+void Publisher::Reader::release() {
+
+	_slot->epoch.store(0);
+}
+
+/**
+ * Predict (on the latest model):
+ */
+
+XCSModel::Action Publisher::Reader::predict(const XCSModel::Perception& state, double* value) {
+
+	XCSModel::Action action = acquire().predict(state,value);
+	release();
+	return action;
+}
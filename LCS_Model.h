@@ -0,0 +1,129 @@
+/**
+==================================
+
+A frozen classifier system compiled from a trained XCS, for serving.
+
+Exploit only (no covering, learning or time) and immutable once built, so
+any number of threads may predict with one model at the same time.
+
+Models can also be published while learning goes on: the learner swaps a
+new one in, readers always see a whole model and never wait, and old
+models are reclaimed once no reader can still be using them (epochs).
+
+==================================
+*/
+
+// Inclusion guard:
+
+#ifndef __MODEL__
+#define __MODEL__
+
+#include "LCS_XCS.h"
+
+#include <atomic>
+
+////////////////////////////////////////////////////////////////
+// Model class:
+
+namespace LCS {
+
+	class XCSModel {
+
+	public:
+
+		typedef XCS::Perception Perception;
+		typedef XCS::Action		Action;
+		typedef XCS::Actions	Actions;
+		typedef XCS::Word		Word;
+
+	public:
+
+		XCSModel();
+		XCSModel(XCS&);
+
+		// Predict (the same action and value as XCS::predict on the population compiled)...
+
+		Action predict(const Perception&,double* value=NULL) const;
+		void predictBatch(const int*,size_t,size_t,Action*,double* values=NULL) const;
+		void predictBatch(const unsigned char*,size_t,size_t,Action*,double* values=NULL) const;
+
+		size_t size() const { return _actionindex.size(); }
+		size_t length() const { return _length; }
+		const Actions& actions() const { return _actions; }
+
+	private:
+
+		template<class F> Action predictRow(const F*,size_t,double*) const;
+		Action best(const Word*,size_t,double*) const;
+
+		// Rules (population order, words of each condition contiguous)...
+
+		size_t			_length;		// Condition bits (longest)
+		size_t			_words;			// Words per condition
+		vector<Word>	_care;
+		vector<Word>	_value;
+		vector<size_t>	_actionindex;
+		vector<double>	_weighted;		// Prediction times fitness
+		vector<double>	_fitness;
+
+		Actions			_actions;
+	};
+
+	/**
+	 * Publisher - one writer swaps models in, any number of readers use the latest:
+	 */
+
+	class Publisher {
+
+		struct Slot;
+
+	public:
+
+		Publisher();
+		~Publisher();
+
+		// Writer (one thread only) - takes ownership, reclaims what it can...
+		void publish(XCSModel*);
+		unsigned long version() const { return _version.load(); }
+		size_t retired() const { return _retired.size(); }
+
+		// Reader (one per thread, holding a slot for as long as it lives)...
+
+		class Reader {
+
+		public:
+
+			Reader(Publisher&);
+			~Reader();
+
+			// Latest model (valid until release)...
+			const XCSModel& acquire();
+			void release();
+
+			XCSModel::Action predict(const XCSModel::Perception&,double* value=NULL);
+
+		private:
+
+			Reader(const Reader&);
+			Reader& operator=(const Reader&);
+
+			Publisher&	_publisher;
+			Slot*		_slot;
+		};
+
+	private:
+
+		Publisher(const Publisher&);
+		Publisher& operator=(const Publisher&);
+
+		atomic<const XCSModel*>	_model;
+		atomic<uint64_t>		_epoch;		// Advanced by every publish (from 1, 0 = reader idle)
+		atomic<unsigned long>	_version;
+		atomic<Slot*>			_slots;		// Readers' epochs (list only grows)
+		vector<pair<const XCSModel*,uint64_t> > _retired;	// Models replaced, and epoch when
+	};
+
+} // End namespace LCS
+
+
+#endif
@@ -0,0 +1,341 @@
+/**
+==================================
+
+Training from files of rows (see LCS_Stream.h).
+
+==================================
+*/
+
+#include "LCS_Stream.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace LCS;
+
+static const char ROWS_MAGIC[8] = {'L','C','S','R','O','W','S','1'};
+static const size_t ROWS_HEADER = 24;
+
+/////////////////////////////////////// RowStream Class:
+
+/**
+ * Constructor (maps a binary file and checks its header, or reads the first line of a CSV):
+ */
+
+RowStream::RowStream(const string& path, Format format, size_t chunk) :
+
+	_path(path),
+	_format(format),
+	_chunk(max(chunk,(size_t)1)),
+	_width(0),
+	_valid(false),
+	_failed(false),
+	_data(NULL),
+	_size(0),
+	_rows(0),
+	_row(0),
+	_header(false)
+{
+	if (_format==BINARY) {
+
+#ifndef _WIN32
+		int fd = open(path.c_str(),O_RDONLY);
+		if (fd<0) return;
+		struct stat st;
+		if (fstat(fd,&st)!=0 || st.st_size<(off_t)ROWS_HEADER) { close(fd); return; }
+		void* data = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+		close(fd);
+		if (data==MAP_FAILED) return;
+		_data = (const char*)data;
+		_size = st.st_size;
+#ifdef MADV_SEQUENTIAL
+		madvise(data,_size,MADV_SEQUENTIAL); // Read ahead
+#endif
+#else
+		ifstream from(path.c_str(),ios::binary);
+		if (!from) return;
+		_contents.assign((istreambuf_iterator<char>(from)),istreambuf_iterator<char>());
+		if (_contents.size()<ROWS_HEADER) return;
+		_data = _contents.data();
+		_size = _contents.size();
+#endif
+
+		// Width no more bits than the file has (so the stride cannot overflow), and the rows in it...
+		uint64_t width, rows;
+		memcpy(&width,_data+8,8);
+		memcpy(&rows,_data+16,8);
+		if (memcmp(_data,ROWS_MAGIC,8)!=0 || width==0 || width/8>_size) return;
+		size_t stride = (width+7)/8 + 8;
+		if ((_size-ROWS_HEADER)/stride<rows) return;
+
+		_width = width;
+		_rows = rows;
+		_chunk = min(_chunk,max((size_t)rows,(size_t)1)); // No bigger than the file
+		_valid = true;
+	}
+	else {
+
+		// Width from the first row (after a header, if the first line is not numbers)...
+		ifstream csv(path.c_str());
+		if (!csv) return;
+		string line;
+		vector<Feature> fields;
+		for (int l=0; l<2 && getline(csv,line); l++) {
+			size_t count = 0;
+			Action label;
+			fields.resize(line.size()+1);
+			if (csvRow(line,fields.data(),label,count) && count>0) {
+				_width = count;
+				_valid = true;
+				break;
+			}
+			_header = true;
+		}
+	}
+
+	// A chunk of features must fit in memory's address space...
+	if (_valid && _chunk>(size_t)-1/sizeof(Feature)/_width) _valid = false;
+}
+
+/**
+ * Destructor:
+ */
+
+RowStream::~RowStream() {
+
+#ifndef _WIN32
+	if (_data) munmap((void*)_data,_size);
+#endif
+}
+
+/**
+ * Feed (an epoch is a pass over the file - parsed on a thread, a chunk ahead of learning):
+ */
+
+bool RowStream::feed(XCS& xcs, unsigned long epochs, Reward correct, Reward wrong, double* accuracy) {
+
+	if (!_valid) return false;
+
+	for (unsigned long e=0; e<epochs && !_failed; e++) {
+
+		rewind();
+		thread parser(&RowStream::parse,this);
+
+		size_t hits = 0, total = 0;
+		for (int k=0; ; k^=1) {
+
+			Chunk& chunk = _chunks[k];
+			{
+				unique_lock<mutex> lock(_lock);
+				while (!chunk.full) _changed.wait(lock);
+			}
+
+			if (chunk.n>0) {
+				double right = 0.0;
+				xcs.fit(chunk.rows.data(),chunk.labels.data(),chunk.n,_width,1,correct,wrong,&right);
+				hits += (size_t)(right*chunk.n+0.5);
+				total += chunk.n;
+			}
+
+			bool last = chunk.last;
+			{
+				lock_guard<mutex> lock(_lock);
+				chunk.full = false;
+			}
+			_changed.notify_all();
+			if (last) break;
+		}
+
+		parser.join();
+		if (accuracy) accuracy[e] = total ? (double)hits/total : 0.0;
+	}
+
+	return !_failed;
+}
+
+/**
+ * Rewind (back to the first row, both chunks free):
+ */
+
+void RowStream::rewind() {
+
+	_row = 0;
+	if (_format==CSV) {
+		_csv.close();
+		_csv.clear();
+		_csv.open(_path.c_str());
+		if (!_csv) _failed = true;
+		else if (_header) getline(_csv,_line);
+	}
+
+	for (int k=0; k<2; k++) {
+		_chunks[k].n = 0;
+		_chunks[k].last = false;
+		_chunks[k].full = false;
+	}
+}
+
+/**
+ * Parse (fill chunks in turn, waiting while the learner has the next one):
+ */
+
+void RowStream::parse() {
+
+	for (int k=0; ; k^=1) {
+
+		Chunk& chunk = _chunks[k];
+		{
+			unique_lock<mutex> lock(_lock);
+			while (chunk.full) _changed.wait(lock);
+		}
+
+		// Out of memory fails the file (rather than terminating on this thread)...
+		bool more;
+		try {
+			chunk.rows.resize(_chunk*_width);
+			chunk.labels.resize(_chunk);
+			more = !_failed && (_format==BINARY ? parseBinary(chunk) : parseCsv(chunk));
+		}
+		catch (const exception&) {
+			_failed = true;
+			chunk.n = 0;
+			more = false;
+		}
+
+		{
+			lock_guard<mutex> lock(_lock);
+			chunk.last = !more;
+			chunk.full = true;
+		}
+		_changed.notify_all();
+		if (!more) return;
+	}
+}
+
+/**
+ * Parse binary (unpack bits of the next rows):
+ */
+
+bool RowStream::parseBinary(Chunk& chunk) {
+
+	const size_t bytes = (_width+7)/8;
+	const size_t stride = bytes + 8;
+
+	chunk.n = 0;
+	while (chunk.n<_chunk && _row<_rows) {
+		const unsigned char* row = (const unsigned char*)_data + ROWS_HEADER + _row*stride;
+		Feature* features = &chunk.rows[chunk.n*_width];
+		for (size_t b=0; b<_width; b++)
+			features[b] = (row[b>>3] >> (b&7)) & 1;
+		int64_t label;
+		memcpy(&label,row+bytes,8);
+		chunk.labels[chunk.n] = (Action)label;
+		chunk.n++;
+		_row++;
+	}
+	return _row<_rows;
+}
+
+/**
+ * Parse CSV (lines of the next rows - a row of the wrong width, or not numbers, fails the file):
+ */
+
+bool RowStream::parseCsv(Chunk& chunk) {
+
+	chunk.n = 0;
+	vector<Feature> fields;
+	while (chunk.n<_chunk) {
+
+		if (!getline(_csv,_line)) return false;
+		if (_line.find_first_not_of(" \t\r")==string::npos) continue; // Blank
+
+		size_t count = 0;
+		if (fields.size()<_line.size()+1) fields.resize(_line.size()+1);
+		if (!csvRow(_line,fields.data(),chunk.labels[chunk.n],count) || count!=_width) {
+			_failed = true;
+			return false;
+		}
+		memcpy(&chunk.rows[chunk.n*_width],fields.data(),_width*sizeof(Feature));
+		chunk.n++;
+	}
+	return true;
+}
+
+/**
+ * CSV row (integers separated by commas, the last the label - count is features):
+ */
+
+bool RowStream::csvRow(const string& line, Feature* features, Action& label, size_t& count) const {
+
+	const char* c = line.c_str();
+	const char* end = c + line.size();
+	long value = 0;
+	size_t fields = 0;
+
+	while (c<end) {
+
+		while (c<end && (*c==' ' || *c=='\t')) c++;
+		bool negative = c<end && *c=='-';
+		if (negative || (c<end && *c=='+')) c++;
+		if (c>=end || *c<'0' || *c>'9') return false;
+		value = 0;
+		while (c<end && *c>='0' && *c<='9') value = value*10 + (*c++ - '0');
+		if (negative) value = -value;
+		while (c<end && (*c==' ' || *c=='\t' || *c=='\r')) c++;
+
+		if (c<end && *c!=',') return false;
+		if (c<end) {
+			features[fields++] = (Feature)value;
+			c++;
+			if (c>=end) return false; // Trailing comma
+		}
+	}
+
+	if (fields==0) return false;
+	label = value;
+	count = fields;
+	return true;
+}
+
+/**
+ * Write (binary rows, bits of nonzero features set):
+ */
+
+bool RowStream::write(const string& path, const int* rows, const Action* labels, size_t n, size_t width) {
+
+	return writeRows(path,rows,labels,n,width);
+}
+
+bool RowStream::write(const string& path, const unsigned char* rows, const Action* labels, size_t n, size_t width) {
+
+	return writeRows(path,rows,labels,n,width);
+}
+
+template<class F> bool RowStream::writeRows(const string& path, const F* rows, const Action* labels, size_t n, size_t width) {
+
+	ofstream to(path.c_str(),ios::binary);
+	if (!to || width==0) return false;
+
+	uint64_t w = width, count = n;
+	to.write(ROWS_MAGIC,8);
+	to.write((const char*)&w,8);
+	to.write((const char*)&count,8);
+
+	vector<unsigned char> row((width+7)/8);
+	for (size_t r=0; r<n; r++) {
+		fill(row.begin(),row.end(),0);
+		for (size_t b=0; b<width; b++)
+			if (rows[r*width+b]) row[b>>3] |= (unsigned char)(1 << (b&7));
+		int64_t label = labels[r];
+		to.write((const char*)row.data(),row.size());
+		to.write((const char*)&label,8);
+	}
+
+	return (bool)to;
+}
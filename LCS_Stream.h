@@ -0,0 +1,114 @@
+/**
+==================================
+
+Training from files of rows and labels too large to hold in memory.
+
+Rows are either packed bits (a binary file, memory mapped) or comma
+separated values (read in chunks, label in the last column, a header
+line skipped). A thread of its own parses the next chunk of rows while
+the system learns from the last one, so learning never waits on parsing
+for long.
+
+Binary files are:
+
+	0	"LCSROWS1"
+	8	width (bits per row, 64 bit little endian)
+	16	rows
+	24	rows, each (width+7)/8 bytes of bits (first bit lowest) then a 64 bit label
+
+==================================
+*/
+
+// Inclusion guard:
+
+#ifndef __STREAM__
+#define __STREAM__
+
+#include "LCS_XCS.h"
+
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+////////////////////////////////////////////////////////////////
+// Row stream class:
+
+namespace LCS {
+
+	class RowStream {
+
+	public:
+
+		typedef XCS::Feature	Feature;
+		typedef XCS::Action		Action;
+		typedef XCS::Reward		Reward;
+
+		enum Format {BINARY=0,CSV};
+
+	public:
+
+		RowStream(const string& path, Format format=BINARY, size_t chunk=65536);	// Rows per chunk
+		~RowStream();
+
+		bool valid() const { return _valid; }	// Opened, and the header (or first row) made sense
+		size_t width() const { return _width; }
+
+		// Learn from every row, epochs times over (shuffled within chunks, as fit does) - false if the file goes bad...
+		bool feed(XCS&, unsigned long epochs, Reward correct=1000, Reward wrong=0, double* accuracy=NULL);
+
+		// Write rows as a binary file...
+		static bool write(const string&, const int*, const Action*, size_t, size_t);
+		static bool write(const string&, const unsigned char*, const Action*, size_t, size_t);
+
+	private:
+
+		RowStream(const RowStream&);
+		RowStream& operator=(const RowStream&);
+
+		struct Chunk {
+
+			vector<Feature>	rows;
+			vector<Action>	labels;
+			size_t			n;
+			bool			last;	// End of the file (or it went bad)
+			bool			full;	// Parsed, not yet learned from
+		};
+
+		template<class F> static bool writeRows(const string&, const F*, const Action*, size_t, size_t);
+
+		void rewind();
+		void parse();				// Background thread (one pass)
+		bool parseBinary(Chunk&);	// False when there are no more rows
+		bool parseCsv(Chunk&);
+		bool csvRow(const string&, Feature*, Action&, size_t&) const;	// Fields of a line (false if not numbers)
+
+		string			_path;
+		Format			_format;
+		size_t			_chunk;
+		size_t			_width;
+		bool			_valid;
+		bool			_failed;
+
+		// Binary (mapped)...
+		const char*		_data;
+		size_t			_size;
+		string			_contents;	// Read whole, where files cannot be mapped
+		size_t			_rows;
+		size_t			_row;		// Next to parse
+
+		// CSV...
+		ifstream		_csv;
+		string			_line;
+		bool			_header;	// First line is not a row
+
+		// Double buffer...
+		Chunk			_chunks[2];
+		mutex			_lock;
+		condition_variable _changed;
+	};
+
+} // End namespace LCS
+
+
+#endif
@@ -0,0 +1,119 @@
+/**
+==================================
+
+Runs of many classifier systems (see LCS_Sweep.h).
+
+==================================
+*/
+
+#include "LCS_Sweep.h"
+
+using namespace LCS;
+
+/////////////////////////////////////// Sweep Class:
+
+/**
+ * Constructor:
+ */
+
+Sweep::Sweep(const XCS::Actions& actions, size_t threads) :
+
+	_actions(actions),
+	_threads(threads)
+{
+}
+
+/**
+ * Add a run (settings applied over the defaults):
+ */
+
+void Sweep::add(const Settings& settings, long seed) {
+
+	Run run;
+	run.settings = settings;
+	run.seed = seed;
+	run.performance = 0.0;
+	run.population = 0;
+	run.seconds = 0.0;
+	_runs.push_back(run);
+}
+
+/**
+ * Grid (every combination of values, first name varying slowest, then every seed):
+ */
+
+void Sweep::grid(const vector<string>& names, const vector<vector<double> >& values, const vector<long>& seeds) {
+
+	size_t combinations = 1;
+	for (size_t n=0; n<names.size() && n<values.size(); n++)
+		combinations *= values[n].size();
+
+	for (size_t c=0; c<combinations; c++) {
+
+		// Digits of the combination pick a value of each...
+		Settings settings(min(names.size(),values.size()));
+		size_t rest = c;
+		for (size_t n=settings.size(); n-->0; ) {
+			settings[n] = make_pair(names[n],values[n][rest%values[n].size()]);
+			rest /= values[n].size();
+		}
+
+		for (size_t s=0; s<seeds.size(); s++)
+			add(settings,seeds[s]);
+	}
+}
+
+void Sweep::clear() {
+
+	_runs.clear();
+}
+
+/**
+ * Run (all runs, spread over the pool):
+ */
+
+bool Sweep::run(const Environment& environment, unsigned long steps, unsigned long every) {
+
+	// Check every setting first...
+	XCS check(_actions);
+	for (size_t r=0; r<_runs.size(); r++)
+		for (size_t s=0; s<_runs[r].settings.size(); s++)
+			if (!check.setParameter(_runs[r].settings[s].first,_runs[r].settings[s].second)) return false;
+
+	_threads.run(_runs.size(),[&](size_t r) {
+		one(environment,_runs[r],steps,every);
+	});
+	return true;
+}
+
+/**
+ * One run (own system and environment, seeded apart from each other):
+ */
+
+void Sweep::one(const Environment& environment, Run& run, unsigned long steps, unsigned long every) {
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	XCS xcs(_actions);
+	for (size_t s=0; s<run.settings.size(); s++)
+		xcs.setParameter(run.settings[s].first,run.settings[s].second);
+	xcs.seed(run.seed,1);
+
+	Environment* copy = environment.clone(run.seed); // ALLOC
+
+	// Final performance over the last tenth when no samples are asked for...
+	unsigned long window = every ? every : max(steps/10,1UL);
+	run.performances.clear();
+	run.populations.clear();
+	xcs.train(*copy,steps,window,&run.performances,&run.populations);
+
+	run.performance = run.performances.empty() ? 0.0 : run.performances.back();
+	run.population = xcs.populationSize();
+	if (!every) {
+		run.performances.clear();
+		run.populations.clear();
+	}
+
+	delete copy; // DEALLOC
+	run.seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
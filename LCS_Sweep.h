@@ -0,0 +1,75 @@
+/**
+==================================
+
+Runs of many classifier systems at once - every setting of parameters (a
+list, or the grid of all combinations) with every seed, each run learning
+its own copy of one environment.
+
+Runs are handed out to a pool of threads as they free up, and results come
+back in the order the runs were added, however many threads there are.
+
+==================================
+*/
+
+// Inclusion guard:
+
+#ifndef __SWEEP__
+#define __SWEEP__
+
+#include "LCS_XCS.h"
+#include "LCS_Environment.h"
+#include "LCS_Threads.h"
+
+////////////////////////////////////////////////////////////////
+// Sweep class:
+
+namespace LCS {
+
+	class Sweep {
+
+	public:
+
+		typedef vector<pair<string,double> > Settings;	// Parameter names and values
+
+		// Result of one run...
+
+		struct Run {
+
+			Settings		settings;
+			long			seed;
+			double			performance;	// Mean reward over the last steps sampled
+			long			population;		// Macroclassifiers at the end
+			double			seconds;		// Wall time
+			vector<double>	performances;	// Sampled every so many steps (if asked)
+			vector<long>	populations;
+		};
+
+	public:
+
+		Sweep(const XCS::Actions&, size_t threads=0);	// Threads (zero = as many as cores)
+
+		// Runs to do...
+
+		void add(const Settings&, long seed);
+		void grid(const vector<string>& names, const vector<vector<double> >& values, const vector<long>& seeds);
+		void clear();
+
+		// Do them all (false if a parameter is unknown, or not a whole number where it must be - nothing is run)...
+		bool run(const Environment&, unsigned long steps, unsigned long every=0);
+
+		const vector<Run>& runs() const { return _runs; }
+		size_t size() const { return _runs.size(); }
+
+	private:
+
+		void one(const Environment&, Run&, unsigned long steps, unsigned long every);
+
+		XCS::Actions	_actions;
+		ThreadPool		_threads;
+		vector<Run>		_runs;
+	};
+
+} // End namespace LCS
+
+
+#endif
@@ -0,0 +1,111 @@
+/**
+==================================
+
+Thread pool (see LCS_Threads.h).
+
+==================================
+*/
+
+#include "LCS_Threads.h"
+
+using namespace LCS;
+
+/////////////////////////////////////// ThreadPool Class:
+
+/**
+ * Constructor (workers wait for the first run):
+ */
+
+ThreadPool::ThreadPool(size_t threads) :
+
+	_task(NULL),
+	_tasks(0),
+	_next(0),
+	_busy(0),
+	_generation(0),
+	_stop(false)
+{
+	if (threads==0) threads = max(thread::hardware_concurrency(),1u);
+	for (size_t t=1; t<threads; t++)
+		_workers.push_back(thread(&ThreadPool::work,this));
+}
+
+/**
+ * Destructor (workers stop and are joined):
+ */
+
+ThreadPool::~ThreadPool() {
+
+	{
+		lock_guard<mutex> lock(_lock);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (size_t t=0; t<_workers.size(); t++)
+		_workers[t].join();
+}
+
+/**
+ * Run (caller claims tasks alongside the workers, then waits for them):
+ */
+
+void ThreadPool::run(size_t tasks, const function<void(size_t)>& task) {
+
+	if (tasks==0) return;
+
+	// Alone, or only one task - no need to wake anyone...
+	if (_workers.empty() || tasks==1) {
+		for (size_t t=0; t<tasks; t++) task(t);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(_lock);
+		_task = &task;
+		_tasks = tasks;
+		_next.store(0);
+		_busy = _workers.size();
+		_generation++;
+	}
+	_wake.notify_all();
+
+	claim();
+
+	// Every worker checks in (so none still holds the task)...
+	unique_lock<mutex> lock(_lock);
+	while (_busy>0) _done.wait(lock);
+	_task = NULL;
+}
+
+/**
+ * Claim tasks until there are none left:
+ */
+
+void ThreadPool::claim() {
+
+	for (size_t t = _next++; t<_tasks; t = _next++)
+		(*_task)(t);
+}
+
+/**
+ * Work (worker threads, from one run to the next):
+ */
+
+void ThreadPool::work() {
+
+	unsigned long seen = 0;
+	while (true) {
+
+		{
+			unique_lock<mutex> lock(_lock);
+			while (!_stop && _generation==seen) _wake.wait(lock);
+			if (_stop) return;
+			seen = _generation;
+		}
+
+		claim();
+
+		lock_guard<mutex> lock(_lock);
+		if (--_busy==0) _done.notify_one();
+	}
+}
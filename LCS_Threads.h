@@ -0,0 +1,67 @@
+/**
+==================================
+
+A persistent pool of worker threads for splitting work into tasks.
+
+The thread that calls run() works on tasks too, and returns only when
+every task is done - so results can be merged in task order afterwards,
+however many threads there are.
+
+==================================
+*/
+
+// Inclusion guard:
+
+#ifndef __THREADS__
+#define __THREADS__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////
+// Thread pool:
+
+namespace LCS {
+
+	class ThreadPool {
+
+	public:
+
+		ThreadPool(size_t threads=0);	// Including the caller (zero = as many as cores)
+		~ThreadPool();
+
+		size_t size() const { return _workers.size()+1; }
+
+		// Run task(0) .. task(tasks-1) across the pool (one caller at a time)...
+		void run(size_t tasks,const function<void(size_t)>& task);
+
+	private:
+
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+
+		void work();
+		void claim();
+
+		vector<thread>			_workers;
+		mutex					_lock;
+		condition_variable		_wake;
+		condition_variable		_done;
+		const function<void(size_t)>* _task;
+		size_t					_tasks;
+		atomic<size_t>			_next;			// Next task to claim
+		size_t					_busy;			// Workers still on this run
+		unsigned long			_generation;	// Runs so far (workers wake on change)
+		bool					_stop;
+	};
+
+} // End namespace LCS
+
+
+#endif
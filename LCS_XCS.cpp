@@ -7,22 +7,35 @@ Tim Lukins (2002)
 
 ==================================
 
-Can also be built to test standalone with:
+Can also be benchmarked standalone (see LCS_Bench.cpp) with:
 
-	g++ -g -DTEST -o xcs LCS_XCS.cpp
+	g++ -O2 -pthread -o xcsbench LCS_Bench.cpp LCS_XCS.cpp LCS_Environment.cpp LCS_Model.cpp LCS_Threads.cpp
 
 And memory tested then with:
 
-  valgrind --tool=memcheck -v ./xcs
+  valgrind --tool=memcheck -v ./xcsbench --steps 1000
 
 Followed by this (to see where exactly):
 
-	valgrind --tool=memcheck --leak-check=full --track-origins=yes -v ./xcs
+	valgrind --tool=memcheck --leak-check=full --track-origins=yes -v ./xcsbench --steps 1000
 
 ==================================
 */
 
 #include "LCS_XCS.h"
+#include "LCS_Environment.h"
+#include "LCS_Model.h"
+#include "LCS_Threads.h"
+
+#include <fstream>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // In global namespace... polymorphism of ostream << and istream >>
 
@@ -44,13 +57,13 @@ ostream& operator<<(ostream& stream, const LCS::XCS::Classifier& cl) {
 	return stream
 		<< con << " "
 		<< (LCS::XCS::Action)cl._action << " " 
-		<< (double)cl._prediction << " "
-		<< (double)cl._error << " "
-		<< (double)cl._fitness << " "
-		<< (unsigned long)cl._experience << " "
-		<< (unsigned long)cl._timestamp << " "
-		<< (unsigned long)cl._actionsetsize << " "
-		<< (unsigned long)cl._numerosity;
+		<< (double)cl.prediction() << " "
+		<< (double)cl.error() << " "
+		<< (double)cl.fitness() << " "
+		<< (unsigned long)cl.experience() << " "
+		<< (unsigned long)cl.timestamp() << " "
+		<< (unsigned long)cl.actionsetsize() << " "
+		<< (unsigned long)cl.numerosity();
 }
 
 /**
@@ -61,9 +74,9 @@ istream& operator>>(istream& stream, LCS::XCS::Classifier& cl) {
 
 	string c;
 	LCS::XCS::Action a;
-	double p;
-	double e;
-	double f;
+	string p;	// Reals read as text (so nan and inf survive)
+	string e;
+	string f;
 	unsigned long x;
 	unsigned long t;
 	unsigned long s;
@@ -85,13 +98,24 @@ istream& operator>>(istream& stream, LCS::XCS::Classifier& cl) {
 	}
 
 	// Assign values to classifier...
-	cl.assign(con,a,p,e,f,x,t,s,n); // TODO: t=sys->_time ?
+	if (stream)
+		cl.assign(LCS::XCS::Classifier::Condition(con),a,strtod(p.c_str(),NULL),strtod(e.c_str(),NULL),strtod(f.c_str(),NULL),x,t,s,n); // TODO: t=sys->_time ?
 
 	return stream;
 }
 
 using namespace LCS;
 
+// Instrumentation of phases and counts (compiled out unless LCS_PROFILE)...
+
+#ifdef LCS_PROFILE
+#define XCS_PHASE(phase) XCS::Timing timing(this,phase)
+#define XCS_COUNT(counter,by) do { if (doProfiling) _profile.counter += by; } while(0)
+#else
+#define XCS_PHASE(phase)
+#define XCS_COUNT(counter,by) do {} while(0)
+#endif
+
 ////////////////////////////////////////// XCS class:
 
 /**
@@ -100,8 +124,9 @@ using namespace LCS;
 
 XCS::XCS(XCS::Actions acts) {
 
-	// The actions available...
+	// The actions available (and their dense indices)...
 	_actions = acts;
+	indexActions();
 
 	// Sensible default values...
 	BETA	= 0.15;
@@ -123,14 +148,34 @@ XCS::XCS(XCS::Actions acts) {
 	// Default control options...
 	doSubsumption	= true; // Subsumption is applied both to action set and GA
 	doLearning		= true; // Create an action set, update it, and apply GA
+	doMultiStep		= false; // Every step pays its own reward
+	_haveprevious	= false;
+	_previousreward	= 0;
+	_payoff			= 0.0;
+	doMatchIndex	= false; // Scan whole population for matches
+	doParallelMatch	= false; // On this thread only
+	_threads		= NULL;
+	_parallelfrom	= 50000;
+	doProfiling		= false; // No timing or counts
 
 	// Reset internal metrics...
 	_time		= 0; // Total epochs running
 	_reinforced = 0; // Epochs when reinforced
-
-	// Initialize random number generator...
-	_seed = ((long)(time(NULL)%10000+1));
-
+	_fitnesssum	= 0.0; // Over population (for deletion)
+	_unbounded	= 0;
+	_numerositysum = 0;
+	_votefitness = 0.0;
+	_tickets.capacity(4096); // Decisions awaiting rewards at most
+	_replay.capacity(0);
+	doRecording	= false; // No replay until asked for
+
+	// Initialize random number generator (differently every run, unless seeded)...
+	_random.seed((uint64_t)chrono::high_resolution_clock::now().time_since_epoch().count() ^ (uint64_t)(uintptr_t)this);
+
+	// Readers always have a model (empty to begin with)...
+	_publisher = new Publisher(); // ALLOC
+	_publishevery = 0;
+	publish();
 }
 
 /**
@@ -140,6 +185,8 @@ XCS::XCS(XCS::Actions acts) {
 XCS::~XCS() {
 
 	clear();
+	delete _publisher; // DEALLOC
+	delete _threads; // DEALLOC
 }
 
 /**
@@ -154,6 +201,17 @@ void XCS::learningOff() {
 	doLearning = false;
 }
 
+void XCS::multiStepOn() {
+	doMultiStep = true;
+	doRecording = false; // Rewards are not payoffs (see replayOn)
+	_haveprevious = false;
+}
+
+void XCS::multiStepOff() {
+	doMultiStep = false;
+	_haveprevious = false;
+}
+
 void XCS::subsumptionOn() {
 	doSubsumption = true;
 }
@@ -162,6 +220,83 @@ void XCS::subsumptionOff() {
 	doSubsumption = false;
 }
 
+void XCS::matchIndexOn() {
+	if (doMatchIndex) return;
+	doMatchIndex = true;
+
+	// Index what is there already...
+	for (ClassifierIter cl = _population.begin();cl!=_population.end(); cl++)
+		_index.insert(*cl);
+}
+
+void XCS::matchIndexOff() {
+	doMatchIndex = false;
+	_index.clear();
+}
+
+void XCS::parallelMatchOn(size_t threads, size_t threshold) {
+
+	// New pool only if the number of threads changes...
+	if (!_threads || (threads && threads!=_threads->size())) {
+		delete _threads; // DEALLOC
+		_threads = new ThreadPool(threads); // ALLOC
+	}
+	_parallelfrom = threshold;
+	doParallelMatch = true;
+}
+
+void XCS::parallelMatchOff() {
+	doParallelMatch = false;
+	delete _threads; // DEALLOC
+	_threads = NULL;
+}
+
+void XCS::profilingOn() {
+	doProfiling = true;
+}
+
+void XCS::profilingOff() {
+	doProfiling = false;
+}
+
+void XCS::seed(long value, unsigned long stream) {
+	_random.seed((uint64_t)value);
+	for (unsigned long s=0; s<stream; s++) _random.jump(); // Independent streams for parallel runs
+}
+
+/**
+ * Set Parameter (by name - false if there is none, or it takes whole numbers and this is not one):
+ */
+
+bool XCS::setParameter(const string& name, double value) {
+
+	// Real valued...
+	if (name=="BETA") BETA = value;
+	else if (name=="GAMMA") GAMMA = value;
+	else if (name=="ALPHA") ALPHA = value;
+	else if (name=="VAL") VAL = value;
+	else if (name=="EPSILON") EPSILON = value;
+	else if (name=="MU") MU = value;
+	else if (name=="XU") XU = value;
+	else if (name=="SIGMA") SIGMA = value;
+	else if (name=="PHASH") PHASH = value;
+	else {
+
+		// Whole numbers (never truncated, and in range of a long)...
+		long* whole = NULL;
+		if (name=="ERROR") whole = &ERROR;
+		else if (name=="N") whole = &N;
+		else if (name=="THETAGA") whole = &THETAGA;
+		else if (name=="THETADEL") whole = &THETADEL;
+		else if (name=="THETASUB") whole = &THETASUB;
+		else if (name=="THETAACT") whole = &THETAACT;
+		if (!whole || floor(value)!=value || !(fabs(value) < 9.2e18)) return false;
+		*whole = (long)value;
+	}
+
+	return true;
+}
+
 /**
  * Query Methods:
  */
@@ -170,6 +305,18 @@ long XCS::populationSize() {
 	return _population.size();
 }
 
+unsigned long XCS::classifiersLive() {
+	return _pool.live();
+}
+
+unsigned long XCS::classifiersAllocated() {
+	return _pool.allocated();
+}
+
+unsigned long XCS::classifiersRecycled() {
+	return _pool.recycled();
+}
+
 double XCS::internalPerformance() {
 	return (double)_reinforced/_time;
 }
@@ -178,19 +325,68 @@ unsigned long XCS::currentTime() {
 	return _time;
 }
 
+/**
+ * Profile (cumulative nanoseconds and calls per phase, and counts):
+ */
+
+map<string,double> XCS::profile() {
+
+	static const char* names[PHASES] = {"match","cover","predict","update","fitness","subsumption","ga","deletion"};
+
+	map<string,double> result;
+	for (int p=0; p<PHASES; p++) {
+		result[string(names[p])+"_ns"] = _profile._nanos[p];
+		result[string(names[p])+"_calls"] = _profile._calls[p];
+	}
+	result["covered"] = _profile._covered;
+	result["ga_invocations"] = _profile._gas;
+	result["offspring"] = _profile._offspring;
+	result["subsumed"] = _profile._subsumed;
+	result["deletions"] = _profile._deletions;
+#ifdef LCS_PROFILE
+	result["compiled"] = 1;
+#else
+	result["compiled"] = 0;
+#endif
+	return result;
+}
+
+/**
+ * Latency Histogram (decisions by log2 of nanoseconds):
+ */
+
+vector<unsigned long> XCS::latencyHistogram() {
+
+	return vector<unsigned long>(_profile._latency,_profile._latency+64);
+}
+
+void XCS::profileClear() {
+
+	_profile.clear();
+}
+
 /**
  * Load:
  */
 
 void XCS::load(istream& from) {
 
+	// Replaces what is there...
+	clear();
+
 	// Read whole line first...
 	string line;
-	while(from >> line) {
+	while(getline(from,line)) {
+
+		if (line.find_first_not_of(" \t\r")==string::npos) continue;
+
 		// Create new classifier and renew it with data...
-		//Classifier* renewed = new Classifier(this); // ALLOC
-		//istringstream fline(line);
-		//fline >> *renewed;
+		Classifier* renewed = _pool.acquire(this); // ALLOC
+		istringstream fline(line);
+		if (fline >> *renewed)
+			addToPopulation(renewed);
+		else
+			_pool.release(renewed); // DEALLOC - not a classifier
 	}
 }
 
@@ -205,53 +401,271 @@ void XCS::save(ostream& to) {
 		to << *(*cl) << endl;
 }
 
+/**
+ * Snapshot (binary, native byte order):
+ *
+ *	header	"XCSS", version, byte order mark, condition bits, words per condition, 0,
+ *			classifier count, time, 0 (version 1's seed - the generator's whole
+ *			state is kept after it instead), reinforced, last proposed action,
+ *			random number generator state, average fitness deletion votes were
+ *			weighed against, fitness sum (112 bytes)
+ *	then one block per field, every classifier in population order...
+ *			care words, value words, action, prediction, error, fitness,
+ *			experience, timestamp, action set size, numerosity
+ */
+
+static const uint32_t SNAPSHOT_VERSION = 3;
+static const uint32_t SNAPSHOT_ORDER = 0x01020304;
+static const size_t SNAPSHOT_HEADER = 112;
+static const size_t SNAPSHOT_HEADER_V1 = 64; // Version 1 held a single seed
+static const size_t SNAPSHOT_HEADER_V2 = 96; // Version 2 no deletion state
+
+bool XCS::saveSnapshot(const string& path) {
+
+	// Conditions must all be the same length...
+	uint32_t length = _population.empty() ? 0 : _population[0]->_condition.size();
+	uint32_t words = (length+63)/64;
+	for (ClassifierIter cl =_population.begin();cl!=_population.end(); cl++)
+		if ((*cl)->_condition.size()!=length) return false;
+
+	ofstream to(path.c_str(),ios::binary);
+	if (!to) return false;
+
+	// Header...
+	uint32_t head[6] = {0,SNAPSHOT_VERSION,SNAPSHOT_ORDER,length,words,0};
+	memcpy(head,"XCSS",4);
+	uint64_t count = _population.size();
+	uint64_t time = _time;
+	int64_t seed = 0; // Version 1's (the state of the generator follows)
+	double reinforced = _reinforced;
+	int64_t proposed = _proposed;
+	to.write((const char*)head,sizeof(head));
+	to.write((const char*)&count,8);
+	to.write((const char*)&time,8);
+	to.write((const char*)&seed,8);
+	to.write((const char*)&reinforced,8);
+	to.write((const char*)&proposed,8);
+	to.write((const char*)_random._s,sizeof(_random._s));
+	to.write((const char*)&_votefitness,8);
+	to.write((const char*)&_fitnesssum,8);
+
+	// Conditions...
+	for (ClassifierIter cl =_population.begin();cl!=_population.end(); cl++)
+		for (size_t w=0; w<words; w++) {
+			Word care = (*cl)->_condition.care(w);
+			to.write((const char*)&care,8);
+		}
+	for (ClassifierIter cl =_population.begin();cl!=_population.end(); cl++)
+		for (size_t w=0; w<words; w++) {
+			Word value = (*cl)->_condition.value(w);
+			to.write((const char*)&value,8);
+		}
+
+	// Actions and parameters...
+	for (ClassifierIter cl =_population.begin();cl!=_population.end(); cl++) {
+		int64_t action = (*cl)->_action;
+		to.write((const char*)&action,8);
+	}
+	vector<double>* reals[3] = {&_params._prediction,&_params._error,&_params._fitness};
+	for (int f=0; f<3; f++)
+		for (ClassifierIter cl =_population.begin();cl!=_population.end(); cl++)
+			to.write((const char*)&(*reals[f])[(*cl)->_id],8);
+	vector<unsigned long>* counts[4] = {&_params._experience,&_params._timestamp,&_params._actionsetsize,&_params._numerosity};
+	for (int f=0; f<4; f++)
+		for (ClassifierIter cl =_population.begin();cl!=_population.end(); cl++) {
+			uint64_t value = (*counts[f])[(*cl)->_id];
+			to.write((const char*)&value,8);
+		}
+
+	return (bool)to;
+}
+
+bool XCS::loadSnapshot(const string& path) {
+
+#ifndef _WIN32
+	// Map it...
+	int fd = open(path.c_str(),O_RDONLY);
+	if (fd<0) return false;
+	struct stat st;
+	if (fstat(fd,&st)!=0 || st.st_size==0) { close(fd); return false; }
+	void* data = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if (data==MAP_FAILED) return false;
+	bool loaded = loadSnapshot((const char*)data,st.st_size);
+	munmap(data,st.st_size);
+	return loaded;
+#else
+	// Or just read it...
+	ifstream from(path.c_str(),ios::binary);
+	if (!from) return false;
+	string data((istreambuf_iterator<char>(from)),istreambuf_iterator<char>());
+	return loadSnapshot(data.data(),data.size());
+#endif
+}
+
+bool XCS::loadSnapshot(const char* data, size_t size) {
+
+	// Check header...
+	if (size<SNAPSHOT_HEADER_V1 || memcmp(data,"XCSS",4)!=0) return false;
+	uint32_t head[6];
+	uint64_t count, time;
+	int64_t seed, proposed;
+	double reinforced;
+	memcpy(head,data,sizeof(head));
+	memcpy(&count,data+24,8);
+	memcpy(&time,data+32,8);
+	memcpy(&seed,data+40,8);
+	memcpy(&reinforced,data+48,8);
+	memcpy(&proposed,data+56,8);
+	if (head[1]<1 || head[1]>SNAPSHOT_VERSION || head[2]!=SNAPSHOT_ORDER) return false;
+	size_t header = head[1]==1 ? SNAPSHOT_HEADER_V1 : head[1]==2 ? SNAPSHOT_HEADER_V2 : SNAPSHOT_HEADER;
+	if (size<header) return false;
+	// Exactly the classifiers counted (by division first, so a huge count cannot wrap round)...
+	size_t length = head[3], words = head[4];
+	size_t stride = (2*words+8)*8;
+	if (words!=(length+63)/64 || (count>0 && words==0)) return false;
+	if (count>(size-header)/stride || size!=header + count*stride) return false;
+
+	// Blocks...
+	const char* care = data + header;
+	const char* value = care + count*words*8;
+	const char* fields = value + count*words*8;
+
+	// Replace population and state...
+	clear();
+	_time = time;
+	if (head[1]==1) _random.seed(seed);
+	else memcpy(_random._s,data+SNAPSHOT_HEADER_V1,sizeof(_random._s));
+	_reinforced = reinforced;
+	double fitnesssum = 0.0;
+	_votefitness = 0.0; // Votes weighed afresh at the first deletion (unless saved)
+	if (head[1]>=3) {
+		memcpy(&_votefitness,data+SNAPSHOT_HEADER_V2,8);
+		memcpy(&fitnesssum,data+SNAPSHOT_HEADER_V2+8,8);
+	}
+	_proposedindex = actionIndex(proposed) < _actions.size() ? actionIndex(proposed) : 0;
+	_proposed = _actions.empty() ? proposed : _actions[_proposedindex];
+
+	vector<Word> c(words), v(words);
+	for (size_t i=0; i<count; i++) {
+
+		Classifier* cl = _pool.acquire(this); // ALLOC
+		memcpy(c.data(),care+i*words*8,words*8);
+		memcpy(v.data(),value+i*words*8,words*8);
+		cl->_condition.assign(length,c.data(),v.data());
+
+		int64_t action;
+		memcpy(&action,fields+i*8,8);
+		cl->_action = action;
+		cl->_actionindex = actionIndex(action);
+
+		uint64_t n;
+		memcpy(&cl->prediction(),fields+(1*count+i)*8,8);
+		memcpy(&cl->error(),fields+(2*count+i)*8,8);
+		memcpy(&cl->fitness(),fields+(3*count+i)*8,8);
+		memcpy(&n,fields+(4*count+i)*8,8); cl->experience() = n;
+		memcpy(&n,fields+(5*count+i)*8,8); cl->timestamp() = n;
+		memcpy(&n,fields+(6*count+i)*8,8); cl->actionsetsize() = n;
+		memcpy(&n,fields+(7*count+i)*8,8); cl->numerosity() = n;
+
+		addToPopulation(cl);
+	}
+
+	// Sum as it was (rather than as added up again)...
+	if (head[1]>=3 && isfinite(fitnesssum)) _fitnesssum = fitnesssum;
+
+	return true;
+}
+
 /**
  * Clear:
  */
 
 void XCS::clear() {
 
-	// Free memory first...
+	// Free memory first (back to the pool)...
 	for (ClassifierIter cl = _population.begin();cl!=_population.end(); cl++)
-		delete(*cl); // DEALLOC
+		_pool.release(*cl); // DEALLOC
 
 	_population.clear(); 
+	_index.clear();
+	_duplicates.clear();
+	_votes.clear();
+	_fitnesssum = 0.0;
+	_unbounded = 0;
+	_numerositysum = 0;
+	_haveprevious = false; // Nothing left to pay
 }
 
 /**
- * Step:
+ * Step (perceive, act and learn from the environment):
  */
-/*
-void XCS::step() {
 
-	// Increment time...
-	_time++;
+void XCS::step(Environment& environment) {
 
 	// Have a look at what's out there...
-	_percept = _environment->perceive();
+	_percept = environment.perceive();
 
-	// Generate match set as a result (covering if necessary)...
-	generateMatchset();
+	// Decide on an action (matching and covering)...
+	decide();
 
-	// Select an action from the match set (based on prediction values)...
-	selectAction();
+	// Execute action and learn from what it pays...
+	Reward reward = environment.act(_proposed);
+	if (doMultiStep) update(reward,environment.done());
+	else update(reward);
+}
 
-	// Execute action and collect reward...
-	if (_reward = _environment->act(_proposed >0)) _reinforced++;
+/**
+ * Train (optionally sampling performance over each interval, and population size, every so many steps):
+ */
 
-	if (doLearning) {
+void XCS::train(Environment& environment, unsigned long steps, unsigned long every, vector<double>* performance, vector<long>* population) {
 
-		// Generate the action set...
-		generateActionSet();
+	double reinforced = _reinforced;
+	for (unsigned long s=1; s<=steps; s++) {
 
-		// Update action set with payoff...
-		updatePrediction();
+		step(environment);
 
-		// Possibly run GA on action set (but actually effect overall population)... 
-		applyGA();
+		if (every && s%every==0) {
+			if (performance) performance->push_back((_reinforced-reinforced)/every);
+			if (population) population->push_back(populationSize());
+			reinforced = _reinforced;
+		}
 	}
 }
-*/
+
+/**
+ * Compile (frozen copy of the population for exploit only):
+ */
+
+XCSModel XCS::compile() {
+
+	return XCSModel(*this);
+}
+
+/**
+ * Publish (a compiled copy, for readers of the publisher):
+ */
+
+void XCS::publish() {
+
+	_publisher->publish(new XCSModel(*this)); // ALLOC - publisher owns it
+}
+
+void XCS::publishEvery(unsigned long steps) {
+
+	_publishevery = steps;
+}
+
+unsigned long XCS::publishingEvery() const {
+
+	return _publishevery;
+}
+
+Publisher& XCS::publisher() {
+
+	return *_publisher;
+}
 
 /**
  * Take action
@@ -259,809 +673,2076 @@ void XCS::step() {
 
 XCS::Action XCS::act(XCS::Perception state) {
 
-	// Increment time...
-	_time++;
-
 	// Have a look at what's out there...
 	_percept = state;
 
+	return decide();
+}
+
+/**
+ * Decide on action for current perception
+ */
+
+XCS::Action XCS::decide() {
+
+#ifdef LCS_PROFILE
+	bool timed = doProfiling;
+	chrono::steady_clock::time_point start;
+	if (timed) start = chrono::steady_clock::now();
+#endif
+
+	// Increment time...
+	_time++;
+
 	// Generate match set as a result (covering if necessary)...
 	generateMatchset();
 
 	// Select an action from the match set (based on prediction values)...
 	selectAction();
 
+#ifdef LCS_PROFILE
+	// Latency by power of two...
+	if (timed) {
+		unsigned long long nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-start).count();
+		_profile._latency[63-__builtin_clzll(nanos|1)]++;
+	}
+#endif
+
 	// Return it
 	return _proposed;
 }
 
 /**
- * Update reward
+ * Predict (exploit only - no covering, learning or time)
  */
 
-void XCS::update(XCS::Reward by) {
-	
-	// Collect reward...
-	_reward = by;	
-	if (_reward>0) _reinforced++;
+XCS::Action XCS::predict(const XCS::Perception& state, double* value) {
 
-	if (doLearning) {
+	return exploit(state,value);
+}
 
-		// Generate the action set...
-		generateActionSet();
+XCS::Action XCS::exploit(const XCS::Perception& state, double* value) {
 
-		// Update action set with payoff...
-		updatePrediction();
+	matchQuery(state);
 
-		// Possibly run GA on action set (but actually effect overall population)... 
-		applyGA();
+	// Action with the highest prediction...
+	predictionArray(_candidates);
+	Action best = _actions.empty() ? 0 : _actions[0];
+	double highest = 0.0;
+	for (size_t a=0; a<_actions.size(); a++) {
+		if (_predictions[a]>highest) {
+			highest = _predictions[a];
+			best = _actions[a];
+		}
 	}
+
+	if (value) *value = highest;
+	return best;
 }
 
 /**
- * Generate Match Set:
+ * Match Query (into candidates, without covering - leaving the match set for learning alone):
  */
 
-void XCS::generateMatchset() {
-	
-	// Record count of proposed actions...
-	Actions proposals;
-
-	// First empty any from last time (only pointers)...
-	_matchset.clear();
-
-	// While matchset is empty...
-	while (_matchset.empty()) {
-
-		// For each classifier in the population...
-		for (ClassifierIter cl = _population.begin();cl!=_population.end(); cl++) {
-
-			// If classifer matches situation...
-			if ((*cl)->matches(_percept)) {
-
-				// Add it to matchset...
-				_matchset.push_back(*cl);
-
-				// Record actions proposed by matching classifiers (no duplicates)...
-				ActionIter already = find(proposals.begin(),proposals.end(),(*cl)->_action);
-				if (already==proposals.end()) proposals.push_back((*cl)->_action);
-			}
-		}
-
-		// If the number of different actions in the matchset is low...
-		if (proposals.size()<THETAACT && doLearning) {
+void XCS::matchQuery(const XCS::Perception& state) {
 
-			// Generate covering classifier in population...
-			Classifier* response = new Classifier(this); // ALLOC
-		  // Was trying this...	
-			//Classifier* response = make_shared<Classifier>(this); // ALLOC
+	pack(state,_querybits);
+	if (doMatchIndex)
+		_index.match(_querybits,_candidates);
+	else if (!matchParallel(_querybits,_candidates)) {
+		_candidates.clear();
+		for (ClassifierIter cl = _population.begin();cl!=_population.end(); cl++)
+			if ((*cl)->matches(_querybits)) _candidates.push_back(*cl);
+	}
+}
 
-			// Find random action not present in Matchset
-			Action rand = _actions[0];
-			do {
-				rand = _actions[(int)(drand()*100)%_actions.size()];
-				ActionIter found = find(proposals.begin(),proposals.end(),rand);
-				if (found==proposals.end()) break;
-			} while(true);
-			// Actually cover...
-			response->cover(_percept,rand);
-			_population.push_back(response);
+/**
+ * Vote (prediction array before normalizing, added to the caller's):
+ */
 
-			// Cull population...
-			deleteFromPopulation();
+void XCS::vote(const XCS::Perception& state, double* weighted, double* fitness) {
 
-			// Empty the match set (so we'll go round again)...
-			_matchset.empty();
-			
-		}
+	matchQuery(state);
+	for (ClassifierIter cl = _candidates.begin();cl!=_candidates.end(); cl++) {
+		size_t a = (*cl)->_actionindex;
+		if (a>=_actions.size()) continue;
+		weighted[a] += (*cl)->prediction() * (*cl)->fitness();
+		fitness[a] += (*cl)->fitness();
 	}
 }
 
 /**
- * Select Action:
+ * Batches (one perception per row)
  */
 
-void XCS::selectAction() {
+void XCS::actBatch(const int* rows, size_t n, size_t width, Action* actions, double* values) {
 
-	//  Initialliaze prediction array...
-	map<Action,double> predictions;
-	map<Action,double> fitsum;
-	ActionIter act;
-	for (act=_actions.begin(); act!=_actions.end(); act++) {
-		predictions[*act]=0.0;
-		fitsum[*act]=0.0;
+	for (size_t r=0; r<n; r++) {
+		_percept.assign(rows+r*width,rows+(r+1)*width);
+		actions[r] = decide();
+		if (values) values[r] = _predictions[_proposedindex];
 	}
+}
+
+void XCS::actBatch(const unsigned char* rows, size_t n, size_t width, Action* actions, double* values) {
 
-	// Generate the prediction array for actions in the match set...
-	for (ClassifierIter cl = _matchset.begin();cl!=_matchset.end(); cl++) {
-		predictions[(*cl)->_action] += (*cl)->_prediction * (*cl)->_fitness;
-		fitsum[(*cl)->_action] += (*cl)->_fitness;
+	for (size_t r=0; r<n; r++) {
+		_percept.assign(rows+r*width,rows+(r+1)*width);
+		actions[r] = decide();
+		if (values) values[r] = _predictions[_proposedindex];
 	}
+}
 
-	// Normalize...
-	for (act=_actions.begin(); act!=_actions.end(); act++)
-		if (fitsum[*act]!=0.0) predictions[*act]=predictions[*act]/fitsum[*act];
+void XCS::predictBatch(const int* rows, size_t n, size_t width, Action* actions, double* values) {
 
-	// Decide what action to take (explore or exploit)...
-	if (drand()<EPSILON) {
-		// Randomly chose an action whose prediction is not zero...
-		long tries = 0; // Put in to avoid indefinite comparison to INF or IND
-		while(true) {
-			_proposed = _actions[(int)(drand()*100)%_actions.size()];
-			if (predictions[_proposed]!=0.0 || (tries++ > 100)) break;
-		}
+	for (size_t r=0; r<n; r++) {
+		_query.assign(rows+r*width,rows+(r+1)*width);
+		actions[r] = exploit(_query,values ? values+r : NULL);
 	}
-	else {
-		// Find the action with the highest prediction...
-		double highest = 0.0;
-		for (act=_actions.begin(); act!=_actions.end(); act++) { 
-			if (predictions[*act]>highest) {
-				highest = predictions[*act];
-				_proposed = *act;
-			}
-		}
+}
+
+void XCS::predictBatch(const unsigned char* rows, size_t n, size_t width, Action* actions, double* values) {
+
+	for (size_t r=0; r<n; r++) {
+		_query.assign(rows+r*width,rows+(r+1)*width);
+		actions[r] = exploit(_query,values ? values+r : NULL);
 	}
 }
 
 /**
- * Generate Action Set:
+ * Update reward
  */
 
-void XCS::generateActionSet() {
+void XCS::update(XCS::Reward by) {
+	
+	// Collect reward (and keep it for replay)...
+	_payoff = by;	
+	if (by>0) _reinforced++;
+	if (doRecording) _replay.push(_percept.data(),_percept.size(),_proposed,by);
 
-	// First empty any from last time (only pointers)...
-	_actionset.clear();
+	if (doLearning) {
+
+		// Generate the action set...
+		generateActionSet();
 
-	// Iterate thro' matchset...
-	for (ClassifierIter cl = _matchset.begin();cl!=_matchset.end(); cl++) {
+		// Update action set with payoff...
+		updatePrediction();
 
-		// Test to see if action is the same as proposed...
-		if ((*cl)->_action == _proposed)
-			_actionset.push_back(*cl);
+		// Possibly run GA on action set (but actually effect overall population)... 
+		applyGA();
 	}
+
+	// Readers see the population so far...
+	if (_publishevery && _time%_publishevery==0) publish();
 }
 
 /**
- * Update predictions:
+ * Update multi-step (previous action set paid its reward plus the discounted best of this step's
+ * prediction array - this one kept for the next step, or paid its reward at the end of the problem):
  */
 
-void XCS::updatePrediction() {
+void XCS::update(XCS::Reward by, bool done) {
 
-        // Total up the numerosity values for all in actionset...
-	long sigman = 0;
-	for (ClassifierIter cn = _actionset.begin();cn!=_actionset.end(); cn++)
-		sigman += (*cn)->_numerosity;
+	if (!doMultiStep) {
+		update(by);
+		return;
+	}
 
-	// Every classifier in the actionset...
-	for (ClassifierIter cl = _actionset.begin();cl!=_actionset.end(); cl++) {
+	if (by>0) _reinforced++;
 
-		// Increase experience...
-		(*cl)->_experience++;
+	if (doLearning) {
 
-		// Update actual prediction values, error and action set size estimate...
-		if ((*cl)->_experience < 1/BETA) { 
-			(*cl)->_prediction		+= (_reward - (*cl)->_prediction) / (*cl)->_experience;
-			(*cl)->_error			+= (abs(_reward - (*cl)->_prediction) - (*cl)->_error) / (*cl)->_experience ;
-			(*cl)->_actionsetsize	+= (sigman - (*cl)->_actionsetsize) / (*cl)->_experience;
-		}
-		else {
-			(*cl)->_prediction		+= BETA * (_reward - (*cl)->_prediction);
-			(*cl)->_error			+= BETA * (abs(_reward - (*cl)->_prediction));
-			(*cl)->_actionsetsize	        += (long)BETA * (sigman - (*cl)->_actionsetsize);
+		// Previous action set (still the partition it was, kept aside by matching)...
+		if (_haveprevious) {
+			double best = 0.0;
+			for (size_t a=0; a<_actions.size(); a++)
+				if (_fitsums[a]!=0.0 && _predictions[a]>best) best = _predictions[a];
+
+			_percept.swap(_previouspercept); // Mutation matches the perception of the time
+			reinforce(_previousreward + GAMMA*best);
+			_percept.swap(_previouspercept);
 		}
+
+		generateActionSet();
+		if (done) reinforce(by);
 	}
 
-	// Update fitness as well...
-	updateFitness();
+	_haveprevious = doLearning && !done;
+	_previousreward = by;
+	if (_haveprevious) _previouspercept = _percept;
 
-	// Check and maybe do some subsumption...
-	if (doSubsumption) doActionSetSubsumption();
+	// Readers see the population so far...
+	if (_publishevery && _time%_publishevery==0) publish();
 }
 
 /**
- * Update fitness...
+ * Act, with a ticket for updating later (action set kept as ids, with their generations):
  */
 
-void XCS::updateFitness() {
+XCS::Action XCS::act(const XCS::Perception& state, XCS::Ticket& ticket) {
 
-	// Init accuracy sum and accuracy vector...
-	long accsum = 0;
-	map<Classifier*,double> accuracy;
+	_percept = state;
+	Action action = decide();
 
-	// Every classifier in the actionset...
-	for (ClassifierIter cl = _actionset.begin();cl!=_actionset.end(); cl++) {
+	Tickets::Slot* slot = _tickets.take(ticket);
+	if (!slot) return action;
 
-		if ((*cl)->_error < ERROR) 
-			accuracy[*cl] = 1;
-		else
-			accuracy[*cl] = ALPHA * pow((*cl)->_error / ERROR,-VAL);
+	slot->percept = _percept;
+	slot->actionindex = _proposedindex;
+	slot->members.clear();
+	const ClassifierList& set = _matchset[_proposedindex];
+	for (ClassifierList::const_iterator cl = set.begin();cl!=set.end(); cl++)
+		slot->members.push_back(make_pair((*cl)->_id,_pool.generation((*cl)->_id)));
 
-		accsum += (long)accuracy[*cl] * (*cl)->_numerosity;
+	return action;
+}
 
-	}
+/**
+ * Update a ticket (its action set less any classifiers deleted since):
+ */
 
-	// Then normalize...
+bool XCS::update(XCS::Ticket ticket, XCS::Reward by) {
 
-	for (ClassifierIter no = _actionset.begin();no!=_actionset.end(); no++)
-		(*no)->_fitness += BETA * (accuracy[*no] * (*no)->_numerosity / accsum - (*no)->_fitness);
+	Tickets::Slot* slot = _tickets.find(ticket);
+	if (!slot) return false;
 
-}
+	_payoff = by;
+	if (by>0) _reinforced++;
 
-/**
- * Apply GA:
+	if (doLearning) {
+
+		// Action set as it was (mutation matches the perception of the time - the last act kept aside)...
+		_percept.swap(slot->percept);
+		swap(_proposedindex,slot->actionindex);
+		_ticketset.clear();
+		_actionids.clear();
+		for (size_t m=0; m<slot->members.size(); m++) {
+			unsigned long id = slot->members[m].first;
+			if (_pool.generation(id)!=slot->members[m].second) continue;
+			_ticketset.push_back(_pool.at(id));
+			_actionids.push_back(id);
+		}
+		ClassifierList* actionset = _actionset;
+		_actionset = &_ticketset;
+
+		updatePrediction();
+		applyGA();
+
+		_percept.swap(slot->percept);
+		swap(_proposedindex,slot->actionindex);
+		_actionset = actionset;
+	}
+
+	_tickets.give(slot);
+
+	// Readers see the population so far...
+	if (_publishevery && _time%_publishevery==0) publish();
+	return true;
+}
+
+size_t XCS::updateMany(const XCS::Ticket* tickets, const XCS::Reward* rewards, size_t n) {
+
+	size_t updated = 0;
+	for (size_t t=0; t<n; t++)
+		if (update(tickets[t],rewards[t])) updated++;
+	return updated;
+}
+
+void XCS::ticketCapacity(size_t capacity) {
+
+	_tickets.capacity(capacity);
+}
+
+size_t XCS::ticketsOutstanding() const {
+
+	return _tickets.outstanding();
+}
+
+/**
+ * Replay On/Off (records kept, and whether updates are recorded):
+ */
+
+bool XCS::replayOn(size_t capacity, bool live) {
+
+	// A multi-step reward is not the payoff of its action alone, so is not recorded...
+	if (live && doMultiStep) return false;
+
+	_replay.capacity(capacity);
+	doRecording = live;
+	return true;
+}
+
+void XCS::replayOff() {
+
+	_replay.capacity(0);
+	doRecording = false;
+}
+
+/**
+ * Remember (load records for replay):
+ */
+
+void XCS::remember(const XCS::Perception& state, XCS::Action action, XCS::Reward reward) {
+
+	_replay.push(state.data(),state.size(),action,reward);
+}
+
+void XCS::remember(const int* rows, const Action* actions, const Reward* rewards, size_t n, size_t width) {
+
+	for (size_t r=0; r<n; r++)
+		_replay.push(rows+r*width,width,actions[r],rewards[r]);
+}
+
+void XCS::remember(const unsigned char* rows, const Action* actions, const Reward* rewards, size_t n, size_t width) {
+
+	for (size_t r=0; r<n; r++)
+		_replay.push(rows+r*width,width,actions[r],rewards[r]);
+}
+
+/**
+ * Replay (records drawn at random - or by priority - and learned from again, one after another):
+ */
+
+void XCS::replay(size_t batch, size_t iterations, bool prioritized) {
+
+	if (_replay.size()==0) return;
+
+	// Offline - time, rewards counted and the live action set are left as they were...
+	ClassifierList* actionset = _actionset;
+	size_t proposedindex = _proposedindex;
+
+	for (size_t i=0; i<iterations; i++) {
+		for (size_t b=0; b<batch; b++) {
+
+			size_t r;
+			double total = _replay.total();
+			if (prioritized && total>0.0) r = _replay.find(_random.uniform()*total);
+			else r = _random.below(_replay.size());
+
+			// Action set of the record (those matching it that advocate its action - none covered)...
+			Replay::Record& record = _replay.at(r);
+			_percept.swap(record.percept); // Mutation matches the record's perception
+			_proposedindex = actionIndex(record.action);
+			matchQuery(_percept);
+			_ticketset.clear();
+			_actionids.clear();
+			double weighted = 0.0, fitness = 0.0;
+			for (ClassifierIter cl = _candidates.begin();cl!=_candidates.end(); cl++) {
+				if ((*cl)->_actionindex!=_proposedindex) continue;
+				_ticketset.push_back(*cl);
+				_actionids.push_back((*cl)->_id);
+				weighted += (*cl)->prediction() * (*cl)->fitness();
+				fitness += (*cl)->fitness();
+			}
+
+			// Priority is how far off the prediction for the action was (before learning)...
+			double predicted = fitness!=0.0 ? weighted/fitness : 0.0;
+			_replay.prioritize(r,abs(record.reward-predicted));
+
+			if (doLearning && !_ticketset.empty()) {
+				_actionset = &_ticketset;
+				_payoff = record.reward;
+				updatePrediction();
+				applyGA();
+			}
+			_percept.swap(record.percept);
+		}
+	}
+
+	_actionset = actionset;
+	_proposedindex = proposedindex;
+}
+
+size_t XCS::replaySize() const {
+
+	return _replay.size();
+}
+
+/**
+ * Learn (an experience acted on elsewhere - matched and covered here, then the action's set updated):
+ */
+
+void XCS::learn(const XCS::Perception& state, XCS::Action action, XCS::Reward reward) {
+
+	take(state,action);
+	update(reward);
+}
+
+void XCS::learn(const XCS::Perception& state, XCS::Action action, XCS::Reward reward, bool done) {
+
+	take(state,action);
+	update(reward,done);
+}
+
+/**
+ * Take (match a perception and propose the action taken for it):
+ */
+
+void XCS::take(const XCS::Perception& state, XCS::Action action) {
+
+	_percept = state;
+	_time++;
+	generateMatchset();
+
+	_proposedindex = actionIndex(action) < _actions.size() ? actionIndex(action) : 0;
+	_proposed = _actions.empty() ? action : _actions[_proposedindex];
+}
+
+/**
+ * Fit (supervised, one pass over the rows in random order each epoch)
+ */
+
+void XCS::fit(const int* rows, const Action* labels, size_t n, size_t width, unsigned long epochs, Reward correct, Reward wrong, double* accuracy) {
+
+	fitRows(rows,labels,n,width,epochs,correct,wrong,accuracy);
+}
+
+void XCS::fit(const unsigned char* rows, const Action* labels, size_t n, size_t width, unsigned long epochs, Reward correct, Reward wrong, double* accuracy) {
+
+	fitRows(rows,labels,n,width,epochs,correct,wrong,accuracy);
+}
+
+template<class F> void XCS::fitRows(const F* rows, const Action* labels, size_t n, size_t width, unsigned long epochs, Reward correct, Reward wrong, double* accuracy) {
+
+	_order.resize(n);
+	for (size_t r=0; r<n; r++) _order[r] = r;
+
+	for (unsigned long e=0; e<epochs; e++) {
+
+		// Shuffle (Fisher-Yates)...
+		for (size_t r=n; r>1; r--)
+			swap(_order[r-1],_order[_random.below(r)]);
+
+		// Act on every row and reward it against its label...
+		size_t right = 0;
+		for (size_t k=0; k<n; k++) {
+			size_t r = _order[k];
+			_percept.assign(rows+r*width,rows+(r+1)*width);
+			bool hit = decide()==labels[r];
+			if (hit) right++;
+			update(hit ? correct : wrong);
+		}
+
+		if (accuracy) accuracy[e] = n ? (double)right/n : 0.0;
+	}
+}
+
+/**
+ * Generate Match Set:
+ */
+
+void XCS::generateMatchset() {
+	
+	XCS_PHASE(MATCH);
+
+	// Record count of proposed actions...
+	size_t proposals = 0;
+	_proposals.assign(_actions.size()+1,0);
+
+	// Pack the perception for word-parallel matching...
+	pack(_percept,_packed);
+
+	// Keep partitions holding the last action set aside...
+	if (_actionsetcurrent) {
+		_matchset.swap(_previous);
+		_actionsetcurrent = false;
+	}
+
+	// First empty any from last time (only pointers), and the prediction array...
+	for (size_t a=0; a<_matchset.size(); a++)
+		_matchset[a].clear();
+	_predictions.assign(_actions.size()+1,0.0);
+	_fitsums.assign(_actions.size()+1,0.0);
+	size_t matched = 0;
+
+	// While matchset is empty...
+	while (matched==0) {
+
+		// Candidates are the whole population, or only those the index (or threads) matched...
+		bool prematched = doMatchIndex;
+		if (doMatchIndex) _index.match(_packed,_candidates);
+		else prematched = matchParallel(_packed,_candidates);
+		ClassifierList& candidates = prematched ? _candidates : _population;
+
+		// For each candidate classifier...
+		for (ClassifierIter cl = candidates.begin();cl!=candidates.end(); cl++) {
+
+			// If classifer matches situation...
+			if (prematched || (*cl)->matches(_packed)) {
+
+				// Add it to matchset (partition of its action) and prediction array...
+				size_t a = (*cl)->_actionindex;
+				_matchset[a].push_back(*cl);
+				_predictions[a] += (*cl)->prediction() * (*cl)->fitness();
+				_fitsums[a] += (*cl)->fitness();
+				matched++;
+
+				// Record actions proposed by matching classifiers (no duplicates)...
+				if (!_proposals[(*cl)->_actionindex]) {
+					_proposals[(*cl)->_actionindex] = 1;
+					proposals++;
+				}
+			}
+		}
+
+		// If the number of different actions in the matchset is low...
+		if (proposals<THETAACT && doLearning) {
+
+			XCS_PHASE(COVER);
+			XCS_COUNT(_covered,1);
+
+			// Generate covering classifier in population...
+			Classifier* response = _pool.acquire(this); // ALLOC
+
+			// Find random action not present in Matchset
+			size_t rand = 0;
+			do {
+				rand = _random.below(_actions.size());
+				if (!_proposals[rand]) break;
+			} while(true);
+			// Actually cover...
+			response->cover(_percept,rand);
+			addToPopulation(response);
+
+			// Cull population...
+			deleteFromPopulation();
+
+			// That may have taken some of the match set, so total it again...
+			matched = proposals = 0;
+			_proposals.assign(_actions.size()+1,0);
+			_predictions.assign(_actions.size()+1,0.0);
+			_fitsums.assign(_actions.size()+1,0.0);
+			for (size_t a=0; a<_matchset.size(); a++) {
+				for (ClassifierIter cl = _matchset[a].begin();cl!=_matchset[a].end(); cl++) {
+					_predictions[a] += (*cl)->prediction() * (*cl)->fitness();
+					_fitsums[a] += (*cl)->fitness();
+				}
+				matched += _matchset[a].size();
+				if (!_matchset[a].empty()) {
+					_proposals[a] = 1;
+					proposals++;
+				}
+			}
+
+			// Go round again only if the match set is empty...
+		}
+	}
+}
+
+/**
+ * Select Action:
+ */
+
+void XCS::selectAction() {
+
+	XCS_PHASE(PREDICT);
+
+	// Normalize the prediction array (accumulated as the match set was generated)...
+	for (size_t a=0; a<_actions.size(); a++)
+		if (_fitsums[a]!=0.0) _predictions[a]=_predictions[a]/_fitsums[a];
+
+	// Decide what action to take (explore or exploit)...
+	if (_random.uniform()<EPSILON) {
+		// Randomly chose an action whose prediction is not zero...
+		long tries = 0; // Put in to avoid indefinite comparison to INF or IND
+		while(true) {
+			_proposedindex = _random.below(_actions.size());
+			if (_predictions[_proposedindex]!=0.0 || (tries++ > 100)) break;
+		}
+	}
+	else {
+		// Find the action with the highest prediction...
+		double highest = 0.0;
+		for (size_t a=0; a<_actions.size(); a++) { 
+			if (_predictions[a]>highest) {
+				highest = _predictions[a];
+				_proposedindex = a;
+			}
+		}
+	}
+	_proposed = _actions[_proposedindex];
+}
+
+/**
+ * Prediction Array (fitness weighted, over matched classifiers):
+ */
+
+void XCS::predictionArray(const ClassifierList& matched) {
+
+	//  Initialliaze prediction array...
+	_predictions.assign(_actions.size()+1,0.0);
+	_fitsums.assign(_actions.size()+1,0.0);
+
+	for (ClassifierList::const_iterator cl = matched.begin();cl!=matched.end(); cl++) {
+		_predictions[(*cl)->_actionindex] += (*cl)->prediction() * (*cl)->fitness();
+		_fitsums[(*cl)->_actionindex] += (*cl)->fitness();
+	}
+
+	// Normalize...
+	for (size_t a=0; a<_actions.size(); a++)
+		if (_fitsums[a]!=0.0) _predictions[a]=_predictions[a]/_fitsums[a];
+}
+
+/**
+ * Match in parallel (chunks of population on the thread pool, merged in population order)
+ * - false when not on, or the population is too small to be worth it:
+ */
+
+static const size_t MATCH_CHUNK = 2048; // Classifiers matched per task
+
+bool XCS::matchParallel(const Bits& sigma, ClassifierList& matched) {
+
+	if (!doParallelMatch || !_threads || _population.size()<_parallelfrom || _population.size()<2*MATCH_CHUNK)
+		return false;
+
+	size_t chunks = (_population.size()+MATCH_CHUNK-1)/MATCH_CHUNK;
+	if (_chunks.size()<chunks) _chunks.resize(chunks);
+
+	Classifier* const* population = _population.data();
+	size_t size = _population.size();
+	_threads->run(chunks,[&](size_t c) {
+		ClassifierList& found = _chunks[c];
+		found.clear();
+		for (size_t i=c*MATCH_CHUNK; i<min(size,(c+1)*MATCH_CHUNK); i++)
+			if (population[i]->matches(sigma)) found.push_back(population[i]);
+	});
+
+	matched.clear();
+	for (size_t c=0; c<chunks; c++)
+		matched.insert(matched.end(),_chunks[c].begin(),_chunks[c].end());
+	return true;
+}
+
+/**
+ * Index Actions (dense positions, for the prediction array):
+ */
+
+void XCS::indexActions() {
+
+	_actionindices.clear();
+	for (size_t a=0; a<_actions.size(); a++)
+		_actionindices.insert(make_pair(_actions[a],a));
+
+	_proposedindex = 0;
+	_proposed = _actions.empty() ? 0 : _actions[0];
+
+	// Match set partitions (no action set yet)...
+	_matchset.assign(_actions.size()+1,ClassifierList());
+	_previous.assign(_actions.size()+1,ClassifierList());
+	_actionset = &_previous.back();
+	_actionsetcurrent = false;
+}
+
+/**
+ * Action Index (unknown actions share the spare slot past the end):
+ */
+
+size_t XCS::actionIndex(Action act) {
+
+	map<Action,size_t>::iterator found = _actionindices.find(act);
+	return found==_actionindices.end() ? _actions.size() : found->second;
+}
+
+/**
+ * Generate Action Set:
+ */
+
+void XCS::generateActionSet() {
+
+	// Simply the matchset partition of the proposed action...
+	_actionset = &_matchset[_proposedindex];
+	_actionsetcurrent = true;
+
+	// And the ids of its classifiers (rows of their parameters)...
+	_actionids.clear();
+	for (ClassifierIter cl = _actionset->begin();cl!=_actionset->end(); cl++)
+		_actionids.push_back((*cl)->_id);
+}
+
+/**
+ * Reinforce the action set with a payoff (ids afresh, as deletion may have taken some since):
+ */
+
+void XCS::reinforce(double payoff) {
+
+	_payoff = payoff;
+
+	_actionids.clear();
+	for (ClassifierIter cl = _actionset->begin();cl!=_actionset->end(); cl++)
+		_actionids.push_back((*cl)->_id);
+
+	updatePrediction();
+	applyGA();
+}
+
+/**
+ * Update predictions:
+ */
+
+void XCS::updatePrediction() {
+
+	XCS_PHASE(UPDATE);
+
+	// Rows of the action set in the parameter arrays...
+	const size_t count = _actionids.size();
+	const unsigned long* ids = _actionids.data();
+	double* prediction = _params._prediction.data();
+	double* error = _params._error.data();
+	unsigned long* experience = _params._experience.data();
+	unsigned long* actionsetsize = _params._actionsetsize.data();
+	const unsigned long* numerosity = _params._numerosity.data();
+
+	// Total up the numerosity values for all in actionset...
+	long sigman = 0;
+	for (size_t k=0; k<count; k++)
+		sigman += numerosity[ids[k]];
+
+	// Every classifier in the actionset...
+	for (size_t k=0; k<count; k++) {
+
+		unsigned long i = ids[k];
+
+		// Increase experience...
+		experience[i]++;
+
+		// Update actual prediction values, error and action set size estimate...
+		if (experience[i] < 1/BETA) { 
+			prediction[i]		+= (_payoff - prediction[i]) / experience[i];
+			error[i]			+= (abs(_payoff - prediction[i]) - error[i]) / experience[i] ;
+			actionsetsize[i]	+= (sigman - actionsetsize[i]) / experience[i];
+		}
+		else {
+			prediction[i]		+= BETA * (_payoff - prediction[i]);
+			error[i]			+= BETA * (abs(_payoff - prediction[i]));
+			actionsetsize[i]	+= (long)BETA * (sigman - actionsetsize[i]);
+		}
+	}
+
+	// Update fitness as well...
+	updateFitness();
+
+	// Deletion votes follow...
+	for (size_t k=0; k<count; k++)
+		revote(ids[k]);
+
+	// Check and maybe do some subsumption...
+	if (doSubsumption) doActionSetSubsumption();
+}
+
+/**
+ * Update fitness...
+ */
+
+void XCS::updateFitness() {
+
+	XCS_PHASE(FITNESS);
+
+	// Rows of the action set in the parameter arrays...
+	const size_t count = _actionids.size();
+	const unsigned long* ids = _actionids.data();
+	const double* error = _params._error.data();
+	double* fitness = _params._fitness.data();
+	const unsigned long* numerosity = _params._numerosity.data();
+
+	// Init accuracy sum and accuracy vector (by position in action set)...
+	long accsum = 0;
+	_accuracy.resize(count);
+	double* accuracy = _accuracy.data();
+
+	// Every classifier in the actionset...
+	for (size_t k=0; k<count; k++) {
+
+		if (error[ids[k]] < ERROR) 
+			accuracy[k] = 1;
+		else
+			accuracy[k] = ALPHA * pow(error[ids[k]] / ERROR,-VAL);
+
+		accsum += (long)accuracy[k] * numerosity[ids[k]];
+
+	}
+
+	// Then normalize...
+
+	for (size_t k=0; k<count; k++) {
+		tallyFitness(fitness[ids[k]],-1);
+		fitness[ids[k]] += BETA * (accuracy[k] * numerosity[ids[k]] / accsum - fitness[ids[k]]);
+		tallyFitness(fitness[ids[k]],1);
+	}
+
+}
+
+/**
+ * Apply GA:
   */
 
-void XCS::applyGA() {
-	
-	// Calculate timestamp average and numerosity...
-	long sumtimestamp = 0;
-	long sumnumerosity = 0;
-	for (ClassifierIter sm = _actionset.begin();sm!=_actionset.end(); sm++) {
-		sumtimestamp += (*sm)->_timestamp;
-		sumnumerosity += (*sm)->_numerosity;
+void XCS::applyGA() {
+	
+	XCS_PHASE(GA);
+
+	// Calculate timestamp average and numerosity...
+	long sumtimestamp = 0;
+	long sumnumerosity = 0;
+	for (size_t k=0; k<_actionids.size(); k++) {
+		sumtimestamp += _params._timestamp[_actionids[k]];
+		sumnumerosity += _params._numerosity[_actionids[k]];
+	}
+
+	// See if the GA actually needs to be applied...
+	double avgtime = sumtimestamp;
+	if (sumnumerosity!=0) sumtimestamp/=sumnumerosity; // Shouldn't happen really....
+	
+	if ((_time - avgtime) > THETAGA) {
+
+		XCS_COUNT(_gas,1);
+
+		// It's GA time! (by position, as deletion can take from the action set)
+		for (size_t k=0; k<_actionset->size(); k++) {
+
+			// Update timestamp of this classifier...
+			(*_actionset)[k]->timestamp() = _time;
+	
+			// Select two parents...
+			Classifier* pa = selectParent();
+			Classifier* ma = selectParent();
+
+			if (pa==NULL || ma==NULL)
+				return; // Population is too small I think...
+			
+			// Copy some new, inexperienced children...
+			Classifier* jack = _pool.acquire(*pa); // ALLOC
+			Classifier* jill = _pool.acquire(*ma); // ALLOC
+			jack->numerosity() = jill->numerosity() = 1;
+			jack->experience() = jill->experience() = 0;
+			XCS_COUNT(_offspring,2);
+
+			// Possibly some crossover...
+			if (_random.uniform() < XU) {
+				applyCrossover(jack,jill);
+				jack->prediction() = jill->prediction() = (pa->prediction() + ma->prediction())/2;
+				jack->error() = jill->error() = (pa->error() + ma->error())/2;
+				jack->fitness() = jill->fitness() = (pa->fitness() + ma->fitness())/2;
+			}
+
+			// Possibly some mutation...
+			if (_random.uniform() < MU)
+				applyMutation(jack);
+			if (_random.uniform() < MU)
+				applyMutation(jill);
+
+			// Check for subsumption...
+			bool pabest, mabest;
+			if (doSubsumption) {
+
+				pabest=doesSubsume(pa,jack);
+				mabest=doesSubsume(ma,jack);
+				if (pabest || mabest) {
+					if (pabest) adjustNumerosity(pa,1);
+					if (mabest) adjustNumerosity(ma,1);
+					_pool.release(jack); // We're not going to use jack //DEALLOC
+					XCS_COUNT(_subsumed,1);
+				}
+				else {
+					insertIntoPopulation(jack);
+				}
+
+				pabest=doesSubsume(pa,jill);
+				mabest=doesSubsume(ma,jill);
+				if (pabest || mabest) {
+					if (pabest) adjustNumerosity(pa,1);
+					if (mabest) adjustNumerosity(ma,1);
+					_pool.release(jill); // We're not going to use jill //DEALLOC
+					XCS_COUNT(_subsumed,1);
+				}
+				else {
+					insertIntoPopulation(jill);
+				}
+			}
+			// Add kids to population anyway...
+			else {
+				insertIntoPopulation(jack);
+				insertIntoPopulation(jill);
+			}
+			// Cull the population if necessary...
+			deleteFromPopulation();
+		}
+	}
+}
+
+/**
+ * Select parent 
+ */
+
+XCS::Classifier* XCS::selectParent() {
+
+	// If no classifiers, return null
+	
+	if (_actionset->size()==0)
+		return NULL;
+
+	// Total up all fitness...
+	double fitsum = 0.0;
+	for (ClassifierIter f = _actionset->begin();f!=_actionset->end(); f++) 
+		fitsum += (*f)->fitness();
+
+	// Select "roulette" point...
+	double spin = _random.uniform() * fitsum;
+
+	// Return first classifier above that point...
+	fitsum = 0.0;
+	ClassifierIter cl;
+	for (cl=_actionset->begin();cl!=_actionset->end(); cl++) {
+		fitsum += (*cl)->fitness();
+		if (fitsum >= spin) break;
+	}
+
+	if (cl==_actionset->end()) // Could potentialy go off end... TODO: shouldn't happen
+	  return NULL; 
+  else
+	  return *cl;
+}
+
+/**
+ * Apply Crossover:
+ */
+
+void XCS::applyCrossover(Classifier* one, Classifier* two){
+
+	// Establish two crossover points...
+	long from = (long)(_random.uniform()*(one->_condition.size()+1));
+	long to = from + (long)(_random.uniform()*((one->_condition.size()-from)+1));
+
+	// Switch over the symbols at those positions...
+	one->_condition.exchange(two->_condition,from,to);
+}
+
+/**
+ * Apply Mutation:
+ */
+
+void XCS::applyMutation(Classifier* cl){
+
+	// Consider every position along the condition (drawing for them all at once)...
+	_uniforms.resize(cl->_condition.size());
+	_random.fill(_uniforms.data(),_uniforms.size());
+	for (int i=0; i<cl->_condition.size(); i++) {
+
+		// If mutatation occurs...
+		if (_uniforms[i] < MU) {
+
+			// Restricted change, geared to matching current perception...
+			if (cl->_condition[i] == XCS::Classifier::DONT) //or 'HASH'
+				cl->_condition.set(i,(XCS::Classifier::Symbol)_percept[i]);
+			else
+				cl->_condition.set(i,XCS::Classifier::DONT);
+		}
+	}
+
+	// Furthermore, the action may change as well...
+	if (_random.uniform() < MU) {
+		cl->_actionindex = _random.below(_actions.size());
+		cl->_action = _actions[cl->_actionindex];
+	}
+}
+
+/**
+ * Insert Into Population:
+ */
+
+void XCS::insertIntoPopulation(Classifier* poss){
+
+	// Check to see if there already exists such a classifier (anywhere in the population)...
+	Classifier* same = _duplicates.find(*poss);
+	if (same) {
+		adjustNumerosity(same,1);
+		_pool.release(poss); // DEALLOC - this is a dupe, so delete it 
+		return; // i.e. Don't add poss
+	}
+
+	// It must be new - so OK to add...
+	addToPopulation(poss);
+
+}
+
+/**
+ * Delete From Population (roulette over the whole population, weighted by deletion vote):
+ */
+
+static const double VOTE_DRIFT = 0.05;	// Average fitness moves before votes are all weighed again
+static const double VOTE_MAX = 1e200;	// Largest vote (so the tree sums stay finite)
+
+void XCS::deleteFromPopulation(){
+
+	XCS_PHASE(DELETION);
+
+	// Until beneath max size (zero is no limit)...
+	while (N>0 && _numerositysum >= (unsigned long)N && !_population.empty()) {
+
+		// Votes are weighed against average fitness in the population (all again if that has drifted)...
+		double avgfitinpop = _unbounded ? HUGE_VAL : _fitnesssum / _numerositysum;
+		if (avgfitinpop!=_votefitness && !(fabs(avgfitinpop - _votefitness) <= VOTE_DRIFT*_votefitness)) {
+			_votefitness = avgfitinpop;
+			revoteAll();
+		}
+
+		// Spin and see where that falls (any at random if there is nothing to vote with)...
+		double total = _votes.total();
+		size_t at = total>0.0 ? _votes.find(_random.uniform() * total) : _random.below(_population.size());
+		Classifier* a = _population[min(at,_population.size()-1)];
+
+		// Reduce numerosity (it's "weight" in voting)...
+		adjustNumerosity(a,-1);
+		XCS_COUNT(_deletions,1);
+
+		// And remove it completely (if numerosity zero)...
+		if (a->numerosity()==0) {
+			removeFromPopulation(a);
+			_pool.release(a); // DEALLOC 
+		}
+	}
+}
+
+/**
+ * Add To Population (and index):
+ */
+
+void XCS::addToPopulation(Classifier* cl) {
+
+	cl->_position = _population.size();
+	_population.push_back(cl);
+	_duplicates.insert(cl);
+	if (doMatchIndex) _index.insert(cl);
+
+	tallyFitness(cl->fitness(),1);
+	_numerositysum += cl->numerosity();
+	revote(cl->_id);
+}
+
+/**
+ * Remove From Population (and index, match set and action set):
+ */
+
+void XCS::removeFromPopulation(Classifier* cl) {
+
+	// The last classifier in the population takes its place (and its vote)...
+	size_t at = cl->_position;
+	if (at<_population.size() && _population[at]==cl) {
+		size_t last = _population.size()-1;
+		_population[at] = _population.back();
+		_population[at]->_position = at;
+		_population.pop_back();
+		_votes.set(at,_votes.vote(last));
+		_votes.set(last,0.0);
+	}
+	_duplicates.remove(cl);
+	if (doMatchIndex) _index.remove(cl);
+
+	tallyFitness(cl->fitness(),-1);
+	_numerositysum -= cl->numerosity();
+
+	// Nor can it stay in the match set (or last action set)...
+	size_t a = cl->_actionindex;
+	ClassifierIter found;
+	if (a<_matchset.size()) {
+		found = find(_matchset[a].begin(),_matchset[a].end(),cl);
+		if (found!=_matchset[a].end()) _matchset[a].erase(found);
+	}
+	if (a<_previous.size()) {
+		found = find(_previous[a].begin(),_previous[a].end(),cl);
+		if (found!=_previous[a].end()) _previous[a].erase(found);
+	}
+	if (_actionset==&_ticketset) {
+		found = find(_ticketset.begin(),_ticketset.end(),cl);
+		if (found!=_ticketset.end()) _ticketset.erase(found);
+	}
+	vector<unsigned long>::iterator id = find(_actionids.begin(),_actionids.end(),cl->_id);
+	if (id!=_actionids.end()) _actionids.erase(id);
+}
+
+/**
+ * Deletion Vote:
+ */
+
+double XCS::deletionVote(unsigned long id, double avgfit) {
+
+	double vote = _params._actionsetsize[id] * _params._numerosity[id];
+
+	// Modify vote weighting accordingly...
+	if (_params._experience[id] > THETADEL && _params._fitness[id]/_params._numerosity[id] <  SIGMA * avgfit)
+		vote *= avgfit/(_params._fitness[id]/_params._numerosity[id]);
+
+	return vote;
+}
+
+/**
+ * Revote (one classifier, or all in population):
+ */
+
+void XCS::revote(unsigned long id) {
+
+	// Only votes the tree can sum (fitness can go to zero, or be undefined)...
+	double vote = deletionVote(id,_votefitness);
+	if (!(vote > 0.0)) vote = 0.0;
+	else if (vote > VOTE_MAX) vote = VOTE_MAX;
+
+	_votes.set(_pool.at(id)->_position,vote);
+}
+
+void XCS::revoteAll() {
+
+	// Sums afresh as well (rounding accumulates)...
+	_votes.clear();
+	_fitnesssum = 0.0;
+	_unbounded = 0;
+	_numerositysum = 0;
+	for (ClassifierIter cl = _population.begin();cl!=_population.end(); cl++) {
+		tallyFitness((*cl)->fitness(),1);
+		_numerositysum += (*cl)->numerosity();
+		revote((*cl)->_id);
 	}
+}
 
-	// See if the GA actually needs to be applied...
-	double avgtime = sumtimestamp;
-	if (sumnumerosity!=0) sumtimestamp/=sumnumerosity; // Shouldn't happen really....
+/**
+ * Tally Fitness (into the sum, or the count of those that cannot be summed):
+ */
+
+void XCS::tallyFitness(double fitness, long by) {
+
+	if (isfinite(fitness)) _fitnesssum += by*fitness;
+	else _unbounded += by;
+}
+
+/**
+ * Adjust Numerosity (keeping sums and vote in step):
+ */
+
+void XCS::adjustNumerosity(Classifier* cl, long by) {
+
+	cl->numerosity() += by;
+	_numerositysum += by;
+	revote(cl->_id);
+}
+
+/**
+ * Do Action Set Subsumption:
+ */
+
+void XCS::doActionSetSubsumption() {
+
+	XCS_PHASE(SUBSUMPTION);
+
+	// Find  the most general classifier in the action set...
+	Classifier* cl = NULL;
+	for (ClassifierIter a = _actionset->begin();a!=_actionset->end(); a++) {
+		if (couldSubsume(*a)) {
+			if (cl == NULL ||
+				countGenerality(*a) > countGenerality(cl) ||
+				((countGenerality(*a) == countGenerality(cl)) && (_random.uniform() < 0.5))) 
+			{
+				  cl = (*a);
+			}
+		}
+	}
 	
-	if ((_time - avgtime) > THETAGA) {
+	// Eliminate any classifiers subsumed by this one...
+	if (cl!=NULL) {
+		for (ClassifierIter c = _actionset->begin();c!=_actionset->end(); c++) {
+			if (moreGeneral(cl,(*c))) {
+				//cl->numerosity() += (*c)->numerosity(); // This line can cause thread issues
+				//_actionset.erase(c); // This is the real problem <--------------------------------------------------!
+				break;
+			}
+		}
+	}
+
+}
+
+/**
+ * Could Subsume:
+ */
+
+bool XCS::couldSubsume(Classifier* cl) {
+
+	if (cl->experience() > THETASUB && cl->error() < ERROR) return true;
+	else return false;
+}
+
+/**
+ * Count Generality:
+ */
+
+long XCS::countGenerality(Classifier* cl) {
+
+	// Total number of times DONT(HASH) occurs...
+	return cl->_condition.generality();
+}
+
+/**
+ * More General:
+ */
+
+bool XCS::moreGeneral(Classifier* gen, Classifier* spec) {
+
+	// Predicate...
+	if (countGenerality(gen) <= countGenerality(spec)) return false;
+	else {
+		// Any position specific in both with the same value (a word at a time)...
+		for (size_t w=0; w<gen->_condition.words(); w++) {
+			if (gen->_condition.care(w) & spec->_condition.care(w) &
+				~(gen->_condition.value(w) ^ spec->_condition.value(w)))
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Does Subsume:
+ */
+
+bool XCS::doesSubsume(Classifier* sub, Classifier* tos) {
+
+	// Predicate...
+	if (sub->_action==tos->_action && couldSubsume(sub) && moreGeneral(sub,tos))
+		return true;
+	else
+		return false;
+}
+
+/**
+ * Pack perception into bits (non-zero features are set)
+ */
+
+void XCS::pack(const Perception& sigma, Bits& bits) {
+
+	bits.assign((sigma.size()+63)/64,0);
+	for (size_t x=0; x<sigma.size(); x++)
+		if (sigma[x]) bits[x>>6] |= (Word)1 << (x&63);
+}
+
+/////////////////////////////////////// Random Class:
+
+/**
+ * Constructor:
+ */
+
+XCS::Random::Random(uint64_t value) {
+
+	seed(value);
+}
+
+/**
+ * Seed (state expanded from one value by splitmix64, so never all zero):
+ */
+
+void XCS::Random::seed(uint64_t value) {
+
+	for (int i=0; i<4; i++) {
+		uint64_t z = (value += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		_s[i] = z ^ (z >> 31);
+	}
+}
+
+/**
+ * Jump (equivalent to 2^128 calls of next):
+ */
+
+void XCS::Random::jump() {
+
+	static const uint64_t JUMP[] = {0x180ec6d33cfd0abaULL,0xd5a61266f0c9392cULL,0xa9582618e03fc9aaULL,0x39abdc4529b1661cULL};
+
+	uint64_t s[4] = {0,0,0,0};
+	for (int i=0; i<4; i++)
+		for (int b=0; b<64; b++) {
+			if (JUMP[i] & ((uint64_t)1 << b))
+				for (int w=0; w<4; w++) s[w] ^= _s[w];
+			next();
+		}
+	memcpy(_s,s,sizeof(_s));
+}
+
+/**
+ * Split:
+ */
+
+XCS::Random XCS::Random::split() {
+
+	Random other(*this);
+	jump();
+	return other;
+}
+
+/**
+ * Fill (uniform over [0,1)):
+ */
+
+void XCS::Random::fill(double* to, size_t n) {
+
+	for (size_t i=0; i<n; i++)
+		to[i] = uniform();
+}
+
+/////////////////////////////////////// Classifier Class:
+
+/**
+ * Constructor:
+ */
+
+XCS::Classifier::Classifier(XCS* sys) :
+
+	// Handle to the system this classifier is part of...
+	_system(sys),
+
+	// Initialize condition (ahead of covering with specifics)...
+	_condition(sys->_percept.size())
+{
+}
+
+/**
+ * Explicit Copy Constructor:
+ */
+/*
+XCS::Classifier::Classifier(const XCS::Classifier& other) {
+
+	this->_system = other._system;
+  this->_condition = other._condition;// Vector copy
+	this->_action = other._action;
+	this->_prediction = other._prediction;
+	this->_error = other._error;
+	this->_fitness = other._fitness;
+	this->_experience = other._experience;
+	this->_timestamp = other._timestamp;
+	this->_actionsetsize = other._actionsetsize;
+	this->_numerosity = other._numerosity;
+}
+*/
+
+/**
+ * Destructor:
+ */
+
+XCS::Classifier::~Classifier() {
+
+	//this->_condition.clear();
+}
+
+/**
+ * Matches:
+ */
+
+bool XCS::Classifier::matches(const Bits& sigma) {
+
+	return _condition.matches(sigma);
+}
+
+/**
+ * Cover:
+ */
+
+void XCS::Classifier::cover(const Perception& sigma, size_t act) {
+
+	// Build condition (drawing for every position at once)...
+	vector<double>& uniforms = _system->_uniforms;
+	uniforms.resize(sigma.size());
+	_system->_random.fill(uniforms.data(),uniforms.size());
+	for (int x=0; x<sigma.size(); x++) {
+		if (uniforms[x]<_system->PHASH) _condition.set(x,DONT);
+		else _condition.set(x,(Symbol)sigma[x]);
+	}
+
+	_action			= _system->_actions[act];
+	_actionindex	= act;
+	prediction()		= 0.01;
+	error()			= 0.01;
+	fitness()		= 0.01;
+	experience()		= 0;
+	timestamp()		= _system->_time;
+	actionsetsize()	= 1;
+	numerosity()		= 1;
+
+
+}
+
+/**
+ * Assign:
+ */
+
+void XCS::Classifier::assign(const Condition& c, Action a, double p, double e, double f, unsigned long x, unsigned long t, unsigned long s, unsigned long n) {
+
+	_condition = c;
+	_action = a;
+	_actionindex = _system->actionIndex(a);
+	prediction() = p;
+	error() = e;
+	fitness() = f;
+	experience() = x;
+	timestamp() = t;
+	actionsetsize() = s;
+	numerosity() = n;
+}
+
+/////////////////////////////////////// Profile Class:
+
+XCS::Profile::Profile() {
+
+	clear();
+}
+
+void XCS::Profile::clear() {
+
+	for (int p=0; p<PHASES; p++) {
+		_nanos[p] = 0;
+		_calls[p] = 0;
+	}
+	_covered = _gas = _offspring = _subsumed = _deletions = 0;
+	for (int b=0; b<64; b++)
+		_latency[b] = 0;
+}
+
+/////////////////////////////////////// Timing Class:
+
+XCS::Timing::Timing(XCS* sys, Phase phase) : _system(sys), _phase(phase), _on(sys->doProfiling) {
+
+	if (_on) _start = chrono::steady_clock::now();
+}
+
+XCS::Timing::~Timing() {
+
+	if (!_on) return;
+	_system->_profile._nanos[_phase] += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-_start).count();
+	_system->_profile._calls[_phase]++;
+}
+
+/////////////////////////////////////// Pool Class:
+
+const size_t XCS::Pool::SLAB;
+
+/**
+ * Constructor:
+ */
+
+XCS::Pool::Pool() {
+
+	_live = 0;
+	_allocated = 0;
+	_recycled = 0;
+}
+
+/**
+ * Destructor (everything constructed in the slabs goes):
+ */
+
+XCS::Pool::~Pool() {
+
+	for (size_t s=0; s<_slabs.size(); s++) {
+		size_t constructed = min((size_t)_allocated - s*SLAB,SLAB);
+		for (size_t c=0; c<constructed; c++)
+			_slabs[s][c].~Classifier();
+		operator delete(_slabs[s]);
+	}
+}
+
+/**
+ * Reuse a released classifier, or construct the next one in a slab:
+ */
+
+XCS::Classifier* XCS::Pool::reuse(XCS* sys) {
+
+	_live++;
+
+	if (!_free.empty()) {
+		Classifier* cl = _free.back();
+		_free.pop_back();
+		_recycled++;
+		return cl;
+	}
+
+	// New slab (and parameter rows to go with it)...
+	if (_allocated == _slabs.size()*SLAB) {
+		_slabs.push_back((Classifier*)operator new(SLAB*sizeof(Classifier))); // ALLOC
+		sys->_params.resize(_slabs.size()*SLAB);
+		_generations.resize(_slabs.size()*SLAB,0);
+	}
+
+	Classifier* cl = new(&_slabs.back()[_allocated%SLAB]) Classifier(sys);
+	cl->_id = _allocated++;
+	return cl;
+}
+
+/**
+ * Acquire blank classifier (all DONT, ahead of covering):
+ */
+
+XCS::Classifier* XCS::Pool::acquire(XCS* sys) {
+
+	Classifier* cl = reuse(sys);
+	cl->_system = sys;
+	cl->_condition.reset(sys->_percept.size());
+	return cl;
+}
+
+/**
+ * Acquire copy of a classifier (keeping own id and storage):
+ */
 
-		// It's GA time!
-		for (ClassifierIter cl = _actionset.begin();cl!=_actionset.end(); cl++) {
+XCS::Classifier* XCS::Pool::acquire(const Classifier& other) {
 
-			// Update timestamp of this classifier...
-			(*cl)->_timestamp = _time;
-	
-			// Select two parents...
-			Classifier* pa = selectParent();
-			Classifier* ma = selectParent();
+	Classifier* cl = reuse(other._system);
+	unsigned long id = cl->_id;
+	*cl = other;
+	cl->_id = id;
+	cl->_system->_params.copy(other._id,id);
+	return cl;
+}
 
-			if (pa==NULL || ma==NULL)
-				return; // Population is too small I think...
-			
-			// Copy some new, inexperienced children...
-			Classifier* jack = new Classifier(*pa); // ALLOC
-			Classifier* jill = new Classifier(*ma); // ALLOC
-			jack->_numerosity = jill->_numerosity = 1;
-			jack->_experience = jill->_experience = 0;
+/**
+ * Release (back onto the free list):
+ */
 
-			// Possibly some crossover...
-			if (drand() < XU) {
-				applyCrossover(jack,jill);
-				jack->_prediction = jill->_prediction = (pa->_prediction + ma->_prediction)/2;
-				jack->_error = jill->_error = (pa->_error + ma->_error)/2;
-				jack->_fitness = jill->_fitness = (pa->_fitness + ma->_fitness)/2;
-			}
+void XCS::Pool::release(Classifier* cl) {
 
-			// Possibly some mutation...
-			if (drand() < MU)
-				applyMutation(jack);
-			if (drand() < MU)
-				applyMutation(jill);
+	_live--;
+	_generations[cl->_id]++; // Tickets holding it are out of date
+	_free.push_back(cl);
+}
 
-			// Check for subsumption...
-			bool pabest, mabest;
-			if (doSubsumption) {
+/////////////////////////////////////// Parameters Class:
 
-				pabest=doesSubsume(pa,jack);
-				mabest=doesSubsume(ma,jack);
-				if (pabest || mabest) {
-					if (pabest) pa->_numerosity++;
-					if (mabest) ma->_numerosity++;
-					delete(jack); // We're not going to use jack //DEALLOC
-				}
-				else {
-					insertIntoPopulation(jack);
-				}
+/**
+ * Resize (rows for that many classifier ids):
+ */
 
-				pabest=doesSubsume(pa,jill);
-				mabest=doesSubsume(ma,jill);
-				if (pabest || mabest) {
-					if (pabest) pa->_numerosity++;
-					if (mabest) ma->_numerosity++;
-					delete(jill); // We're not going to use jill //DEALLOC
-				}
-				else {
-					insertIntoPopulation(jill);
-				}
-			}
-			// Add kids to population anyway...
-			else {
-				insertIntoPopulation(jack);
-				insertIntoPopulation(jill);
-			}
-			// Cull the population if necessary...
-			deleteFromPopulation();
-		}
-	}
+void XCS::Parameters::resize(size_t rows) {
+
+	_prediction.resize(rows,0.0);
+	_error.resize(rows,0.0);
+	_fitness.resize(rows,0.0);
+	_experience.resize(rows,0);
+	_timestamp.resize(rows,0);
+	_actionsetsize.resize(rows,0);
+	_numerosity.resize(rows,0);
 }
 
 /**
- * Select parent 
+ * Copy one row to another:
  */
 
-XCS::Classifier* XCS::selectParent() {
+void XCS::Parameters::copy(unsigned long from, unsigned long to) {
 
-	// If no classifiers, return null
-	
-	if (_actionset.size()==0)
-		return NULL;
+	_prediction[to] = _prediction[from];
+	_error[to] = _error[from];
+	_fitness[to] = _fitness[from];
+	_experience[to] = _experience[from];
+	_timestamp[to] = _timestamp[from];
+	_actionsetsize[to] = _actionsetsize[from];
+	_numerosity[to] = _numerosity[from];
+}
 
-	// Total up all fitness...
-	double fitsum = 0.0;
-	for (ClassifierIter f = _actionset.begin();f!=_actionset.end(); f++) 
-		fitsum += (*f)->_fitness;
+/////////////////////////////////////// MatchIndex Class:
 
-	// Select "roulette" point...
-	double spin = drand() * fitsum;
+/**
+ * Constructor:
+ */
 
-	// Return first classifier above that point...
-	fitsum = 0.0;
-	ClassifierIter cl;
-	for (cl=_actionset.begin();cl!=_actionset.end(); cl++) {
-		fitsum += (*cl)->_fitness;
-		if (fitsum >= spin) break;
-	}
+XCS::MatchIndex::MatchIndex() {
 
-	if (cl==_actionset.end()) // Could potentialy go off end... TODO: shouldn't happen
-	  return NULL; 
-  else
-	  return *cl;
+	_length = 0;
+	_words = 0;
 }
 
 /**
- * Apply Crossover:
+ * Clear:
  */
 
-void XCS::applyCrossover(Classifier* one, Classifier* two){
+void XCS::MatchIndex::clear() {
 
-	// Establish two crossover points...
-	long from = (long)(drand()*(one->_condition.size()+1));
-	long to = from + (long)(drand()*((one->_condition.size()-from)+1));
+	_length = 0;
+	_words = 0;
+	_reject.clear();
+	_live.clear();
+	_slots.clear();
+}
 
-	// Switch over the symbols at those positions...
-	for (int i=from; i<to; i++) {
-		XCS::Classifier::Symbol temp	= one->_condition[i];
-		one->_condition[i] = two->_condition[i];
-		two->_condition[i] = temp;
+/**
+ * Grow to cover more bits and/or slots (rows are per bit and value):
+ */
+
+void XCS::MatchIndex::grow(size_t length, size_t words) {
+
+	if (words > _words) {
+		vector<Word> reject(2*_length*words,0);
+		for (size_t r=0; r<2*_length; r++)
+			copy(_reject.begin()+r*_words,_reject.begin()+(r+1)*_words,reject.begin()+r*words);
+		_reject.swap(reject);
+		_live.resize(words,0);
+		_words = words;
+	}
+	if (length > _length) {
+		_reject.resize(2*length*_words,0);
+		_length = length;
 	}
 }
 
 /**
- * Apply Mutation:
+ * Insert (in the slot of its id):
  */
 
-void XCS::applyMutation(Classifier* cl){
+void XCS::MatchIndex::insert(Classifier* cl) {
 
-	// Consider every position along the condition...
-	for (int i=0; i<cl->_condition.size(); i++) {
+	unsigned long id = cl->_id;
+	if (id >= _slots.size()) _slots.resize(id+1,NULL);
+	_slots[id] = cl;
 
-		// If mutatation occurs...
-		if (drand() < MU) {
+	// Make room (doubling slots)...
+	grow(cl->_condition.size(),max(_words,(size_t)1));
+	while (id >= _words*64) grow(_length,_words*2);
 
-			// Restricted change, geared to matching current perception...
-			if (cl->_condition[i] == XCS::Classifier::DONT) //or 'HASH'
-				cl->_condition[i] = (XCS::Classifier::Symbol)_percept[i];
-			else
-				cl->_condition[i] = XCS::Classifier::DONT;
-		}
+	// Mark every bit value the condition rejects...
+	Word bit = (Word)1 << (id&63);
+	for (size_t b=0; b<cl->_condition.size(); b++) {
+		Classifier::Symbol sym = cl->_condition[b];
+		if (sym==Classifier::ONCE) _reject[(2*b)*_words + (id>>6)] |= bit;
+		else if (sym==Classifier::ZERO) _reject[(2*b+1)*_words + (id>>6)] |= bit;
 	}
-
-	// Furthermore, the action may change as well...
-	if (drand() < MU) 
-		cl->_action = _actions[(int)(drand()*_actions.size())];
+	_live[id>>6] |= bit;
 }
 
 /**
- * Insert Into Population:
+ * Remove (clearing its slot):
  */
 
-void XCS::insertIntoPopulation(Classifier* poss){
-
-	// Check to see if there already exists such a classifier...
-	for (ClassifierIter cl = _actionset.begin();cl!=_actionset.end(); cl++) {
+void XCS::MatchIndex::remove(Classifier* cl) {
 
-		if ((*cl)->_condition == poss->_condition && (*cl)->_action  == poss->_action) {
-			(*cl)->_numerosity++;
-			delete(poss); // DEALLOC - this is a dupe, so delete it 
-			return; // i.e. Don't add poss
-		}
-	}
+	unsigned long id = cl->_id;
+	if (id >= _slots.size() || _slots[id]!=cl) return;
 
-	// It must be new - so OK to add...
-	_population.push_back(poss);
+	Word bit = (Word)1 << (id&63);
+	for (size_t r=0; r<2*_length; r++)
+		_reject[r*_words + (id>>6)] &= ~bit;
+	_live[id>>6] &= ~bit;
 
+	_slots[id] = NULL;
 }
 
 /**
- * Delete From Population:
+ * Match - same classifiers, in the same (population) order, as a full scan:
  */
 
-void XCS::deleteFromPopulation(){
+static bool earlierPosition(const XCS::Classifier* a, const XCS::Classifier* b) {
+	return a->_position < b->_position;
+}
+
+void XCS::MatchIndex::match(const Bits& sigma, ClassifierList& into) {
+
+	into.clear();
+	_matched = _live;
 
-	// Check first to see if beneath max size anyway...
-	long sumnum = 0;
-	double sumfit = 0.0;
-	for (ClassifierIter n = _actionset.begin();n!=_actionset.end(); n++) {
-		sumnum += (*n)->_numerosity;
-		sumfit += (*n)->_fitness;
+	// Knock out slots rejecting each bit of the perception...
+	for (size_t b=0; b<_length; b++) {
+		size_t v = (b>>6) < sigma.size() ? (sigma[b>>6] >> (b&63)) & 1 : 0;
+		const Word* reject = &_reject[(2*b+v)*_words];
+		for (size_t w=0; w<_words; w++)
+			_matched[w] &= ~reject[w];
 	}
-	if (sumnum < N) return;
 
-	// If OK - establish distribution of "vote"...
-	double votesum = 0.0;
-	double avgfitinpop = sumfit / sumnum;
-	for (ClassifierIter v = _actionset.begin();v!=_actionset.end(); v++)
-		votesum += deletionVote(*v,avgfitinpop);
+	// Collect survivors...
+	for (size_t w=0; w<_words; w++)
+		for (Word bits=_matched[w]; bits; bits&=bits-1)
+			into.push_back(_slots[w*64 + __builtin_ctzll(bits)]);
 
-	// Spin and see...
-	double spin = drand() * votesum;
+	sort(into.begin(),into.end(),earlierPosition);
+}
 
-	// Find where that falls...
-	votesum = 0.0;
-	for (ClassifierIter a = _actionset.begin();a!=_actionset.end(); a++) {
-		votesum += deletionVote(*a,avgfitinpop);
-		if (votesum > spin) {
+/////////////////////////////////////// Votes Class:
 
-			// Reduce numerosity (it's "weight" in voting)...
-			(*a)->_numerosity--;
-			
-			// And remove it completely (if numerosity zero)...
-			if ((*a)->_numerosity==0)
-				delete(*a); // DEALLOC 
-				_population.erase(a); 
+/**
+ * Clear:
+ */
 
-			// Only update that one classifier...
-			return;
-		}
-	}
+void XCS::Votes::clear() {
+
+	_vote.clear();
+	_tree.clear();
 }
 
 /**
- * Deletion Vote:
+ * Rebuild sums for at least that many votes (linear time):
  */
 
-double XCS::deletionVote(Classifier* cl, double avgfit) {
+void XCS::Votes::rebuild(size_t size) {
 
-	double vote = cl->_actionsetsize * cl->_numerosity;
-
-	// Modify vote weighting accordingly...
-	if (cl->_experience > THETADEL && cl->_fitness/cl->_numerosity <  SIGMA * avgfit)
-		vote *= avgfit/(cl->_fitness/cl->_numerosity);
+	size_t leaves = 1;
+	while (leaves<size) leaves *= 2;
 
-	return vote;
+	_vote.resize(leaves,0.0);
+	_tree.assign(2*leaves,0.0);
+	copy(_vote.begin(),_vote.end(),_tree.begin()+leaves);
+	for (size_t p=leaves-1; p>0; p--)
+		_tree[p] = _tree[2*p] + _tree[2*p+1];
 }
 
 /**
- * Do Action Set Subsumption:
+ * Set the vote at a position (growing to twice the size if need be):
  */
 
-void XCS::doActionSetSubsumption() {
+void XCS::Votes::set(unsigned long at, double vote) {
 
-	// Find  the most general classifier in the action set...
-	Classifier* cl = NULL;
-	for (ClassifierIter a = _actionset.begin();a!=_actionset.end(); a++) {
-		if (couldSubsume(*a)) {
-			if (cl == NULL ||
-				countGenerality(*a) > countGenerality(cl) ||
-				((countGenerality(*a) == countGenerality(cl)) && (drand() < 0.5))) 
-			{
-				  cl = (*a);
-			}
-		}
-	}
-	
-	// Eliminate any classifiers subsumed by this one...
-	if (cl!=NULL) {
-		for (ClassifierIter c = _actionset.begin();c!=_actionset.end(); c++) {
-			if (moreGeneral(cl,(*c))) {
-				//cl->_numerosity += (*c)->_numerosity; // This line can cause thread issues
-				//_actionset.erase(c); // This is the real problem <--------------------------------------------------!
-				break;
-			}
-		}
+	if (at>=_vote.size()) {
+		if (vote==0.0) return;
+		rebuild(max((size_t)at+1,2*_vote.size()));
 	}
 
+	// Sums above it added up again (not adjusted by the change)...
+	_vote[at] = vote;
+	size_t p = _vote.size() + at;
+	_tree[p] = vote;
+	for (p/=2; p>0; p/=2)
+		_tree[p] = _tree[2*p] + _tree[2*p+1];
 }
 
 /**
- * Could Subsume:
+ * Total of all votes:
  */
 
-bool XCS::couldSubsume(Classifier* cl) {
+double XCS::Votes::total() const {
 
-	if (cl->_experience > THETASUB && cl->_error < ERROR) return true;
-	else return false;
+	return _tree.empty() ? 0.0 : _tree[1];
 }
 
 /**
- * Count Generality:
+ * Find the position where the running total first passes the spin:
  */
 
-long XCS::countGenerality(Classifier* cl) {
+unsigned long XCS::Votes::find(double spin) const {
 
-	long total = 0;
-	// Total number of times DONT(HASH) occurs...
-	for (int s=0; s<cl->_condition.size(); s++)
-		if (cl->_condition[s]==XCS::Classifier::DONT) total++;
-	return total;
+	size_t size = _vote.size(), p = 1;
+	if (size==0) return 0;
+
+	// Descend into the half the spin falls in...
+	while (p<size) {
+		if (spin < _tree[2*p]) p = 2*p;
+		else {
+			spin -= _tree[2*p];
+			p = 2*p+1;
+		}
+	}
+	size_t pos = p - size;
+
+	// Rounding can put it on one without a vote...
+	while (pos>0 && _vote[pos]<=0.0) pos--;
+	while (pos+1<size && _vote[pos]<=0.0) pos++;
+	return pos;
 }
 
+/////////////////////////////////////// Tickets Class:
+
 /**
- * More General:
+ * Capacity (all slots free again, outstanding tickets spent):
  */
 
-bool XCS::moreGeneral(Classifier* gen, Classifier* spec) {
+void XCS::Tickets::capacity(size_t capacity) {
 
-	// Predicate...
-	if (countGenerality(gen) <= countGenerality(spec)) return false;
-	else {
-		for (int i=0; i<gen->_condition.size(); i++) {
-			if (gen->_condition[i]!=XCS::Classifier::DONT &&
-				gen->_condition[i]==spec->_condition[i])
-				return false;
-		}
+	for (size_t s=0; s<_slots.size(); s++) {
+		_slots[s].used = false;
+		_slots[s].generation++;
 	}
-	return true;
+	_slots.resize(capacity);
+
+	_free.clear();
+	for (size_t s=capacity; s-->0; ) _free.push_back((uint32_t)s);
 }
 
 /**
- * Does Subsume:
+ * Take (ticket is generation then slot, never zero):
  */
 
-bool XCS::doesSubsume(Classifier* sub, Classifier* tos) {
+XCS::Tickets::Slot* XCS::Tickets::take(Ticket& ticket) {
 
-	// Predicate...
-	if (sub->_action==tos->_action && couldSubsume(sub) && moreGeneral(sub,tos))
-		return true;
-	else
-		return false;
+	ticket = 0;
+	if (_free.empty()) return NULL;
+
+	uint32_t s = _free.back();
+	_free.pop_back();
+	Slot* slot = &_slots[s];
+	slot->used = true;
+	if (++slot->generation==0) slot->generation = 1; // Tickets are never zero
+	ticket = ((Ticket)slot->generation << 32) | s;
+	return slot;
 }
 
 /**
- * Random number generator returning double over standard distribution from 0->1
+ * Find:
  */
-	
-double XCS::drand() {
-
-  long M = 2147483647;
-  long A = 16807; 
-  long Q = M/A;
-  long R = M%A;
-  long lo,hi,test;
-  
-  hi   = _seed / Q;
-  lo   = _seed % Q;
-  test = A*lo - R*hi;
-  
-  if (test>0)
-    _seed = test;
-  else
-    _seed = test+M;
 
-  return (double)(_seed)/M;
+XCS::Tickets::Slot* XCS::Tickets::find(Ticket ticket) {
 
-}
+	size_t s = (size_t)(ticket & 0xffffffffu);
+	if (s>=_slots.size()) return NULL;
 
-#ifdef TEST
+	Slot* slot = &_slots[s];
+	if (!slot->used || slot->generation!=(uint32_t)(ticket >> 32)) return NULL;
+	return slot;
+}
 
 /**
- * Testing with XOR problem
+ * Give back:
  */
 
-void XCS::test() {
-	
-	cout << "+++START+++" << endl;
-
-	_actions.clear();
-	_actions.push_back(0); // i.e. output from xor
-	_actions.push_back(1);
+void XCS::Tickets::give(Slot* slot) {
 
-	THETAACT=_actions.size(); // Directly set
+	slot->used = false;
+	_free.push_back((uint32_t)(slot-&_slots[0]));
+}
 
-	// If you do this 1000 times you should flush memory issues...
+/////////////////////////////////////// Replay Class:
 
-	for (int i=0;i<=1000;i++) {
+static const double REPLAY_FLOOR = 1.0; // Least priority (so every record can come up)
+static const double REPLAY_ALPHA = 0.6; // Errors soften into priorities (not all on the worst)
 
-		cout << "Time = " << _time++ << endl;;
+/**
+ * Capacity (emptied, storage kept where it can be):
+ */
 
-		//cout << "Drand = " << drand() << endl;
+void XCS::Replay::capacity(size_t capacity) {
 
-		int situation = ((int)(drand()*100))%4; // i.e. 00,01,10, or 11
+	_records.resize(capacity);
+	_next = _size = 0;
+	_priorities.clear();
+	_highest = REPLAY_FLOOR;
+}
 
-		_percept.clear();
-		switch(situation) {
-		case 0: {
-			cout << "Percept -> [00]" << endl;
-			_percept.push_back(0);
-			_percept.push_back(0);
-			break;
-		}
-		case 1: {
-			cout << "Percept -> [01]" << endl;
-			_percept.push_back(0);
-			_percept.push_back(1);
-			break;
-		}
-		case 2: {
-			cout << "Percept -> [10]" << endl;
-			_percept.push_back(1);
-			_percept.push_back(0);
-			break;
-		}
-		case 3: {
-			cout << "Percept -> [11]" << endl;
-			_percept.push_back(1);
-			_percept.push_back(1);
-			break;
-		}
-		}
+/**
+ * Push:
+ */
 
-		ClassifierIter cl;
+template<class F> void XCS::Replay::push(const F* row, size_t width, Action action, Reward reward) {
 
-		cout << "+++ Generating match set +++" << endl;
+	if (_records.empty()) return;
 
-		generateMatchset();
+	Record& record = _records[_next];
+	record.percept.assign(row,row+width);
+	record.action = action;
+	record.reward = reward;
+	_priorities.set(_next,_highest);
 
-		for (cl = _matchset.begin();cl!=_matchset.end(); cl++)
-			cout << "In matchset: " << *(*cl) << endl;
+	_next = (_next+1) % _records.size();
+	if (_size<_records.size()) _size++;
+}
 
-		cout << "+++ Selecting action +++" << endl;
+/**
+ * Prioritize:
+ */
 
-		selectAction();
+void XCS::Replay::prioritize(size_t r, double priority) {
 
-		cout << "Action chosen: " << _proposed << endl;
+	priority = max(pow(priority,REPLAY_ALPHA),REPLAY_FLOOR);
+	_priorities.set(r,priority);
+	_highest = max(_highest,priority);
+}
 
-		// Calculate if correct action chosen...
+/////////////////////////////////////// Duplicates Class:
 
-		if (_proposed==1 && (situation==1 || situation==2)) // i.e. 1 on 10 or 01
-			_reward = 1000;
-		else if (_proposed==0 && (situation==0 || situation==3)) // i.e. 0 on 00 or 11
-			_reward = 1000;
-		else
-			_reward = -1000;
+/**
+ * Clear:
+ */
 
-		cout << "Reward of " << _reward << endl;
+void XCS::Duplicates::clear() {
 
-		if (_reward>0) _reinforced++;
+	_table.clear();
+}
 
-		cout << "+++ Generating action set +++" << endl;
+/**
+ * Key (condition and action):
+ */
 
-		generateActionSet();
+uint64_t XCS::Duplicates::key(const Classifier& cl) {
 
-		for (cl = _actionset.begin();cl!=_actionset.end(); cl++)
-			cout << "In actionset: " << *(*cl) << endl;
+	uint64_t h = cl._condition.hash() ^ ((uint64_t)cl._action * 0xff51afd7ed558ccdULL);
+	return h ^ (h >> 29);
+}
 
-		cout << "+++ Updating predictions +++" << endl;
+/**
+ * Insert:
+ */
 
-		updatePrediction();
+void XCS::Duplicates::insert(Classifier* cl) {
 
-		for (cl = _population.begin();cl!=_population.end(); cl++)
-			cout << "In population: " << *(*cl) << endl;
+	_table.insert(make_pair(key(*cl),cl));
+}
 
-		cout << "+++ Applying GA +++" << endl;
+/**
+ * Remove (that classifier only - copies loaded from file may share its key):
+ */
 
-		applyGA();
+void XCS::Duplicates::remove(Classifier* cl) {
 
-		for (cl = _population.begin();cl!=_population.end(); cl++)
-			cout << "In population: " << *(*cl) << endl;
+	pair<unordered_multimap<uint64_t,Classifier*>::iterator,unordered_multimap<uint64_t,Classifier*>::iterator> range = _table.equal_range(key(*cl));
+	for (unordered_multimap<uint64_t,Classifier*>::iterator it=range.first; it!=range.second; it++)
+		if (it->second==cl) {
+			_table.erase(it);
+			return;
+		}
+}
 
-		cout << "+++ Pop size = " << populationSize() << " +++" << endl;
-		cout << "+++ Int Perf = " << internalPerformance() << " +++" << endl; 
+/**
+ * Find one with the same condition and action (or NULL):
+ */
 
-	}
+XCS::Classifier* XCS::Duplicates::find(const Classifier& cl) const {
 
-	cout << "+++END+++" << endl;
+	pair<unordered_multimap<uint64_t,Classifier*>::const_iterator,unordered_multimap<uint64_t,Classifier*>::const_iterator> range = _table.equal_range(key(cl));
+	for (unordered_multimap<uint64_t,Classifier*>::const_iterator it=range.first; it!=range.second; it++)
+		if (it->second->_action==cl._action && it->second->_condition==cl._condition)
+			return it->second;
+	return NULL;
 }
 
-int main(int argv,char** argc) { 
-	XCS::Actions acts; 
-	XCS dummy(acts); 
-	dummy.test(); 
+/////////////////////////////////////// Condition Class:
+
+/**
+ * Constructors (all DONT, or from symbols):
+ */
+
+XCS::Classifier::Condition::Condition(size_t length) :
+	_length(length), _care((length+63)/64,0), _value((length+63)/64,0) {
 }
 
-#endif 
+XCS::Classifier::Condition::Condition(const vector<Symbol>& symbols) :
+	_length(symbols.size()), _care((symbols.size()+63)/64,0), _value((symbols.size()+63)/64,0) {
 
-/////////////////////////////////////// Classifier Class:
+	for (size_t i=0; i<symbols.size(); i++)
+		set(i,symbols[i]);
+}
 
 /**
- * Constructor:
+ * Assign packed words directly (keeping storage):
  */
 
-XCS::Classifier::Classifier(XCS* sys) {
+void XCS::Classifier::Condition::assign(size_t length, const Word* care, const Word* value) {
 
-	// Handle to the system this classifier is part of...
-	_system = sys;
+	_length = length;
+	_care.assign(care,care+(length+63)/64);
+	_value.assign(value,value+(length+63)/64);
+}
 
-	// Initialize condition (ahead of covering with specifics)...
-	for (int i=0; i<_system->_percept.size(); i++)
-		_condition.push_back(DONT);
+/**
+ * Reset to all DONT (keeping storage):
+ */
+
+void XCS::Classifier::Condition::reset(size_t length) {
 
+	_length = length;
+	_care.assign((length+63)/64,0);
+	_value.assign((length+63)/64,0);
 }
 
 /**
- * Explicit Copy Constructor:
+ * Symbol at a position:
  */
-/*
-XCS::Classifier::Classifier(const XCS::Classifier& other) {
 
-	this->_system = other._system;
-  this->_condition = other._condition;// Vector copy
-	this->_action = other._action;
-	this->_prediction = other._prediction;
-	this->_error = other._error;
-	this->_fitness = other._fitness;
-	this->_experience = other._experience;
-	this->_timestamp = other._timestamp;
-	this->_actionsetsize = other._actionsetsize;
-	this->_numerosity = other._numerosity;
+XCS::Classifier::Symbol XCS::Classifier::Condition::operator[](size_t i) const {
+
+	Word bit = (Word)1 << (i&63);
+	if (!(_care[i>>6] & bit)) return DONT;
+	return (_value[i>>6] & bit) ? ONCE : ZERO;
 }
-*/
 
 /**
- * Destructor:
+ * Set symbol at a position:
  */
 
-XCS::Classifier::~Classifier() {
+void XCS::Classifier::Condition::set(size_t i, Symbol sym) {
 
-	//this->_condition.clear();
+	Word bit = (Word)1 << (i&63);
+	if (sym==DONT) _care[i>>6] &= ~bit;
+	else _care[i>>6] |= bit;
+	if (sym==ONCE) _value[i>>6] |= bit;
+	else _value[i>>6] &= ~bit;
 }
 
 /**
- * Matches:
+ * Equality (value bits are kept clear under DONT, so words compare directly):
  */
 
-bool XCS::Classifier::matches(Perception sigma) {
+bool XCS::Classifier::Condition::operator==(const Condition& other) const {
+
+	return _length==other._length && _care==other._care && _value==other._value;
+}
 
-	// For each attribute of the condition...	
-	for (int x=0; x<_condition.size(); x++) {
+/**
+ * Matches packed perception - i.e. no cared-for bit differs:
+ */
 
-		// Check to see if we don't care, or if it equals...
-		if (_condition[x]!=DONT && _condition[x]!=(Symbol)sigma[x]) return false;
+bool XCS::Classifier::Condition::matches(const Bits& sigma) const {
+
+	size_t words = min(_care.size(),sigma.size());
+	const Word* care = words ? &_care[0] : NULL;
+	const Word* value = words ? &_value[0] : NULL;
+	const Word* bits = words ? &sigma[0] : NULL;
+	size_t w = 0;
+
+#ifdef __AVX2__
+	// Long conditions four words at a time...
+	for (; w+4<=words; w+=4) {
+		__m256i diff = _mm256_and_si256(
+			_mm256_xor_si256(
+				_mm256_loadu_si256((const __m256i*)(bits+w)),
+				_mm256_loadu_si256((const __m256i*)(value+w))),
+			_mm256_loadu_si256((const __m256i*)(care+w)));
+		if (!_mm256_testz_si256(diff,diff)) return false;
 	}
+#endif
+
+	for (; w<words; w++)
+		if ((bits[w] ^ value[w]) & care[w]) return false;
 
 	return true;
 }
 
 /**
- * Cover:
+ * Generality (number of DONT symbols):
  */
 
-void XCS::Classifier::cover(Perception sigma, Action act) {
+long XCS::Classifier::Condition::generality() const {
 
-	// Build condition...
-	for (int x=0; x<sigma.size(); x++) {
-		if (_system->drand()<_system->PHASH) _condition[x]=DONT;
-		else _condition[x]=(Symbol)sigma[x];
-	}
+	long specific = 0;
+	for (size_t w=0; w<_care.size(); w++)
+		specific += __builtin_popcountll(_care[w]);
+	return _length - specific;
+}
 
-	_action			= act;
-	_prediction		= 0.01;
-	_error			= 0.01;
-	_fitness		= 0.01;
-	_experience		= 0;
-	_timestamp		= _system->_time;
-	_actionsetsize	= 1;
-	_numerosity		= 1;
+/**
+ * Hash (of the packed words - DONT positions always have a clear value bit):
+ */
 
+uint64_t XCS::Classifier::Condition::hash() const {
 
+	uint64_t h = _length * 0x9e3779b97f4a7c15ULL;
+	for (size_t w=0; w<_care.size(); w++) {
+		h = (h ^ _care[w]) * 0xbf58476d1ce4e5b9ULL;
+		h = (h ^ _value[w]) * 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+	}
+	return h;
 }
 
 /**
- * Assign:
+ * Exchange symbols in [from,to) with another condition (a word at a time):
  */
 
-void XCS::Classifier::assign(vector<Symbol> c, Action a, double p, double e, double f, unsigned long x, unsigned long t, unsigned long s, unsigned long n) {
+void XCS::Classifier::Condition::exchange(Condition& other, size_t from, size_t to) {
 
-	_condition = c;
-	_action = a;
-	_prediction = p;
-	_error = e;
-	_fitness = f;
-	_experience = x;
-	_timestamp = t;
-	_actionsetsize = s;
-	_numerosity = n;
-}
+	for (size_t w=from>>6; from<to && w<=(to-1)>>6; w++) {
+
+		// Mask of the positions within this word...
+		size_t lo = max(from,w*64) - w*64;
+		size_t hi = min(to,w*64+64) - w*64;
+		Word mask = (hi==64 ? ~(Word)0 : ((Word)1<<hi)-1) & ~(((Word)1<<lo)-1);
 
+		Word c = (_care[w] ^ other._care[w]) & mask;
+		_care[w] ^= c; other._care[w] ^= c;
+		Word v = (_value[w] ^ other._value[w]) & mask;
+		_value[w] ^= v; other._value[w] ^= v;
+	}
+}
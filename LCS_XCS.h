@@ -19,11 +19,18 @@ Tim Lukins (2002)
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <sstream>
 #include <ctime>
 #include <cmath>
 #include <memory>
+#include <stdint.h>
+#include <chrono>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -32,6 +39,11 @@ using namespace std;
 
 namespace LCS {
 
+	class Environment;
+	class XCSModel;
+	class Publisher;
+	class ThreadPool;
+
 	class XCS {
 
 	public:
@@ -63,6 +75,9 @@ namespace LCS {
 		typedef long			Action;
 		typedef vector<Action>	Actions;
 		typedef long			Reward;
+		typedef uint64_t		Word;	// Packed bits (64 to a word)
+		typedef vector<Word>	Bits;
+		typedef uint64_t		Ticket;	// Decision awaiting its reward (zero = none)
 
 		// TODO: Exception class as well?
 
@@ -80,17 +95,87 @@ namespace LCS {
 
 		void load(istream&);
 		void save(ostream&); 
+		bool loadSnapshot(const string&);
+		bool loadSnapshot(const char*,size_t);
+		bool saveSnapshot(const string&);
 		void clear();
-		//void step();
+		void step(Environment&);
 		Action act(Perception);
 		void update(Reward);
+		void update(Reward,bool done);	// Multi-step (done = end of the problem), otherwise as update
+		void learn(const Perception&,Action,Reward);	// Experience with the action already taken (e.g. from a model)
+		void learn(const Perception&,Action,Reward,bool done);	// Multi-step (as update)
+
+		// Decisions rewarded later and in any order (a ticket each, from a bounded pool - zero when none is free)...
+
+		Action act(const Perception&,Ticket&);
+		bool update(Ticket,Reward);		// False if the ticket is unknown or spent
+		size_t updateMany(const Ticket*,const Reward*,size_t);	// How many were updated
+		void ticketCapacity(size_t);	// Tickets outstanding at most (dropping any outstanding)
+		size_t ticketsOutstanding() const;
+
+		// Experience replay (a ring of records - from live updates, or loaded - learned from again in batches)...
+
+		bool replayOn(size_t capacity,bool live=true);	// Keeping that many records (the latest), recording updates if live (false if live and multi-step)
+		void replayOff();
+		void remember(const Perception&,Action,Reward);
+		void remember(const int*,const Action*,const Reward*,size_t,size_t);
+		void remember(const unsigned char*,const Action*,const Reward*,size_t,size_t);
+		void replay(size_t batch,size_t iterations,bool prioritized=false);	// Prioritized by error of the last prediction (time stands still)
+		size_t replaySize() const;
+		void train(Environment&,unsigned long,unsigned long every=0,vector<double>* performance=NULL,vector<long>* population=NULL);
+		XCSModel compile();	// Frozen copy for serving (see LCS_Model.h)
+
+		// Serving while learning (models published by the learner, read by any thread)...
+
+		void publish();
+		void publishEvery(unsigned long);	// Steps between publishing (zero = only when asked)
+		unsigned long publishingEvery() const;
+		Publisher& publisher();
+		Action predict(const Perception&,double* value=NULL);
+
+		// Fitness weighted prediction, and fitness, summed per action (added in, in order of actions - for combining systems)...
+		void vote(const Perception&,double* weighted,double* fitness);
+
+		// Batches of perceptions (row-major, one per row)...
+
+		void actBatch(const int*,size_t,size_t,Action*,double* values=NULL);
+		void actBatch(const unsigned char*,size_t,size_t,Action*,double* values=NULL);
+		void predictBatch(const int*,size_t,size_t,Action*,double* values=NULL);
+		void predictBatch(const unsigned char*,size_t,size_t,Action*,double* values=NULL);
+
+		// Supervised (reward computed from labels, rows shuffled every epoch, accuracy per epoch)...
+
+		void fit(const int*,const Action*,size_t,size_t,unsigned long,Reward,Reward,double* accuracy=NULL);
+		void fit(const unsigned char*,const Action*,size_t,size_t,unsigned long,Reward,Reward,double* accuracy=NULL);
 
 		void learningOn(); 
 		void learningOff();
+		void multiStepOn();		// Payoff is reward plus GAMMA times best prediction of the next step
+		void multiStepOff();
 		void subsumptionOn();
 		void subsumptionOff();
+		void matchIndexOn();
+		void matchIndexOff();
+		void parallelMatchOn(size_t threads=0,size_t threshold=50000);	// Threads (zero = cores), and smallest population matched in parallel
+		void parallelMatchOff();
+		void profilingOn();
+		void profilingOff();
+		void seed(long,unsigned long stream=0);
+		bool setParameter(const string&,double);	// By name (false if there is none, or a fraction for a whole number)
 
 		long populationSize();
+		unsigned long classifiersLive();
+		unsigned long classifiersAllocated();
+		unsigned long classifiersRecycled();
+
+		// Instrumentation (phases timed only when built with LCS_PROFILE)...
+
+		enum Phase {MATCH=0,COVER,PREDICT,UPDATE,FITNESS,SUBSUMPTION,GA,DELETION,PHASES};
+
+		map<string,double> profile();
+		vector<unsigned long> latencyHistogram();
+		void profileClear();
 		double internalPerformance();
 		unsigned long currentTime();
 
@@ -99,6 +184,44 @@ namespace LCS {
 
 	public:
 
+		// Random number generator (xoshiro256++, seeded through splitmix64)...
+
+		class Random {
+
+		public:
+
+			Random(uint64_t seed=1);
+
+			void seed(uint64_t);
+			void jump();		// Skip 2^128 draws (to start an independent stream)
+			Random split();		// Copy for another stream, jumping this one past it
+			void fill(double*,size_t);
+
+			uint64_t next() {
+				uint64_t result = rotl(_s[0]+_s[3],23) + _s[0];
+				uint64_t t = _s[1] << 17;
+				_s[2] ^= _s[0];
+				_s[3] ^= _s[1];
+				_s[1] ^= _s[2];
+				_s[0] ^= _s[3];
+				_s[2] ^= t;
+				_s[3] = rotl(_s[3],45);
+				return result;
+			}
+
+			// Uniform over [0,1) from the top 53 bits...
+			double uniform() { return (next() >> 11) * (1.0/9007199254740992.0); }
+
+			// Uniform over 0..n-1...
+			size_t below(size_t n) { return (size_t)(uniform()*n); }
+
+			uint64_t _s[4];	// State (kept in snapshots)
+
+		private:
+
+			static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64-k)); }
+		};
+
 		// Internal data structures:
 
 		class Classifier {
@@ -107,16 +230,53 @@ namespace LCS {
 
 			enum Symbol {ZERO=0,ONCE=1,DONT=2};
 
+			// Ternary condition packed as care-mask and value bits...
+
+			class Condition {
+
+			public:
+
+				Condition(size_t length=0);
+				Condition(const vector<Symbol>&);
+
+				size_t size() const { return _length; }
+				size_t words() const { return _care.size(); }
+				Word care(size_t w) const { return _care[w]; }
+				Word value(size_t w) const { return _value[w]; }
+
+				void reset(size_t);
+				void assign(size_t,const Word*,const Word*);
+				Symbol operator[](size_t) const;
+				void set(size_t,Symbol);
+				bool operator==(const Condition&) const;
+				bool matches(const Bits&) const;
+				long generality() const;
+				uint64_t hash() const;
+				void exchange(Condition&,size_t,size_t);
+
+			private:
+
+				size_t			_length;
+				vector<Word>	_care;	// Bit set if not DONT (i.e. specific)
+				vector<Word>	_value;	// Bit set if ONCE (always clear when DONT)
+			};
+
 			XCS*			_system;
-			vector<Symbol>  _condition; 
+			Condition		_condition; 
 			Action			_action;
-			double			_prediction;
-			double			_error;
-			double			_fitness;
-			unsigned long	_experience;
-			unsigned long	_timestamp;
-			unsigned long	_actionsetsize;
-			unsigned long	_numerosity;
+			size_t			_actionindex;	// Position of action in system's actions
+			unsigned long	_id;		// Slot in the pool (fixed) - and row of parameters
+			size_t			_position;	// In population (moves as others are taken out)
+
+			// Parameters (held by the system, structure-of-arrays)...
+
+			double& prediction() const			{ return _system->_params._prediction[_id]; }
+			double& error() const				{ return _system->_params._error[_id]; }
+			double& fitness() const				{ return _system->_params._fitness[_id]; }
+			unsigned long& experience() const	{ return _system->_params._experience[_id]; }
+			unsigned long& timestamp() const	{ return _system->_params._timestamp[_id]; }
+			unsigned long& actionsetsize() const { return _system->_params._actionsetsize[_id]; }
+			unsigned long& numerosity() const	{ return _system->_params._numerosity[_id]; }
 
 		public:
 
@@ -124,9 +284,9 @@ namespace LCS {
 			//Classifier(const Classifier&); not needed as default one will work
 			virtual ~Classifier();
 
-			bool matches(Perception);
-			void cover(Perception,Action);
-			void assign(vector<Symbol>,Action,double,double,double,unsigned long,unsigned long, unsigned long, unsigned long);
+			bool matches(const Bits&);
+			void cover(const Perception&,size_t);
+			void assign(const Condition&,Action,double,double,double,unsigned long,unsigned long, unsigned long, unsigned long);
 
 			friend class XCS;
 		};
@@ -137,6 +297,10 @@ namespace LCS {
 
 		bool doSubsumption;
 		bool doLearning;
+		bool doMultiStep;
+		bool doMatchIndex;
+		bool doParallelMatch;
+		bool doProfiling;
 
 		// Data:
 
@@ -145,27 +309,290 @@ namespace LCS {
 
 		typedef vector<Action>::iterator ActionIter;
 
+		// Classifier parameters, structure-of-arrays (rows by classifier id)...
+
+		class Parameters {
+
+		public:
+
+			void resize(size_t);
+			void copy(unsigned long,unsigned long);
+
+			vector<double>			_prediction;
+			vector<double>			_error;
+			vector<double>			_fitness;
+			vector<unsigned long>	_experience;
+			vector<unsigned long>	_timestamp;
+			vector<unsigned long>	_actionsetsize;
+			vector<unsigned long>	_numerosity;
+		};
+
+		// Cumulative timings and counts...
+
+		class Profile {
+
+		public:
+
+			Profile();
+			void clear();
+
+			unsigned long long	_nanos[PHASES];	// Inclusive of nested phases
+			unsigned long		_calls[PHASES];
+			unsigned long		_covered;		// Covering events
+			unsigned long		_gas;			// GA invocations (that went ahead)
+			unsigned long		_offspring;		// Children created by GA
+			unsigned long		_subsumed;		// ... of which subsumed by parents
+			unsigned long		_deletions;		// Numerosity removed by deletion
+			unsigned long		_latency[64];	// Decisions by log2 nanoseconds taken
+		};
+
+		// Times a phase for as long as it is in scope...
+
+		class Timing {
+
+		public:
+
+			Timing(XCS*,Phase);
+			~Timing();
+
+		private:
+
+			XCS*	_system;
+			Phase	_phase;
+			bool	_on;	// Profiling when phase began
+			chrono::steady_clock::time_point _start;
+		};
+
+		// Slab allocator recycling classifiers (and their condition storage)...
+
+		class Pool {
+
+		public:
+
+			Pool();
+			~Pool();
+
+			Classifier* acquire(XCS*);
+			Classifier* acquire(const Classifier&);
+			void release(Classifier*);
+
+			unsigned long live() const { return _live; }
+			unsigned long allocated() const { return _allocated; }
+			unsigned long recycled() const { return _recycled; }
+			Classifier* at(unsigned long id) const { return &_slabs[id/SLAB][id%SLAB]; }
+			unsigned long generation(unsigned long id) const { return _generations[id]; }	// Releases of an id so far
+
+		private:
+
+			Classifier* reuse(XCS*);
+
+			static const size_t SLAB = 256;
+
+			vector<Classifier*> _slabs;
+			vector<unsigned long> _generations;
+			ClassifierList	_free;
+			unsigned long	_live;		// Acquired and not yet released
+			unsigned long	_allocated;	// Constructed in slabs so far
+			unsigned long	_recycled;	// Acquisitions served from the free list
+		};
+
+		// Inverted index of population by condition bit...
+
+		class MatchIndex {
+
+		public:
+
+			MatchIndex();
+
+			void clear();
+			void insert(Classifier*);
+			void remove(Classifier*);
+			void match(const Bits&,ClassifierList&);
+
+		private:
+
+			void grow(size_t,size_t);
+
+			size_t			_length;	// Condition bits indexed
+			size_t			_words;		// Words per slot bitset
+			vector<Word>	_reject;	// Per bit and value: slots that reject it
+			vector<Word>	_live;		// Slots in use
+			vector<Word>	_matched;	// Scratch for matching
+			ClassifierList	_slots;		// By classifier id
+		};
+
+		// Deletion votes by population position (so roulette is the same for the same population, whatever
+		// the ids), as a binary tree of sums (sums and roulette in log time - though
+		// weighing every vote again, when average fitness drifts, is linear). Each sum is added up afresh
+		// from its two halves, so votes coming and going many orders of magnitude apart leave no residue...
+
+		class Votes {
+
+		public:
+
+			void clear();
+			void set(unsigned long,double);
+			double vote(unsigned long at) const { return at<_vote.size() ? _vote[at] : 0.0; }
+			double total() const;
+			unsigned long find(double) const;
+
+		private:
+
+			void rebuild(size_t);
+
+			vector<double>	_vote;	// By position (zero past the population), a power of two of them
+			vector<double>	_tree;	// Sums of halves (one based, votes themselves from the size of _vote)
+		};
+
+		// Hash index of population by condition and action (for merging duplicates)...
+
+		class Duplicates {
+
+		public:
+
+			void clear();
+			void insert(Classifier*);
+			void remove(Classifier*);
+			Classifier* find(const Classifier&) const;
+
+		private:
+
+			static uint64_t key(const Classifier&);
+
+			unordered_multimap<uint64_t,Classifier*> _table;
+		};
+
+		// Ring of records to replay (each keeps its storage, so no allocation once warm)...
+
+		class Replay {
+
+		public:
+
+			struct Record {
+
+				Perception	percept;
+				Action		action;
+				Reward		reward;
+			};
+
+			void capacity(size_t);
+			size_t capacity() const { return _records.size(); }
+			size_t size() const { return _size; }
+			Record& at(size_t r) { return _records[r]; }
+			template<class F> void push(const F*,size_t,Action,Reward);	// Over the oldest when full
+
+			// Priorities by record (a new record gets the highest so far)...
+			void prioritize(size_t,double);
+			double total() const { return _priorities.total(); }
+			size_t find(double spin) const { return _priorities.find(spin); }
+
+		private:
+
+			vector<Record>	_records;
+			size_t			_next;		// Written next
+			size_t			_size;
+			Votes			_priorities;
+			double			_highest;
+		};
+
+		// Bounded pool of tickets (each keeps its storage, so no allocation once warm)...
+
+		class Tickets {
+
+		public:
+
+			struct Slot {
+
+				Perception		percept;	// For mutation
+				size_t			actionindex;
+				vector<pair<unsigned long,unsigned long> > members;	// Ids of action set, and their generations
+				uint32_t		generation;	// Uses so far (tickets of earlier uses are spent)
+				bool			used;
+			};
+
+			void capacity(size_t);
+			Slot* take(Ticket&);		// NULL when none is free
+			Slot* find(Ticket);			// NULL when unknown or spent
+			void give(Slot*);
+			size_t outstanding() const { return _slots.size()-_free.size(); }
+
+		private:
+
+			vector<Slot>	_slots;
+			vector<uint32_t> _free;
+		};
+
 		ClassifierList	_population;
-		ClassifierList	_matchset;
-		ClassifierList	_actionset;
-		Reward			_reward;
+		vector<ClassifierList> _matchset;	// Partitioned by action index
+		vector<ClassifierList> _previous;	// Partitions the action set was last taken from
+		ClassifierList*	_actionset;			// One partition (not copied)
+		vector<unsigned long> _actionids;	// Ids of action set (for parameter updates)
+		vector<double>	_accuracy;			// Scratch by position in action set
+		bool			_actionsetcurrent;	// Action set taken since last match
+		Tickets			_tickets;
+		ClassifierList	_ticketset;			// Action set of the ticket being updated (or the record replayed)
+		Replay			_replay;
+		bool			doRecording;		// Updates recorded for replay (single-step only)
+		ClassifierList	_candidates;	// Matched by the index (or in parallel)
+		ThreadPool*		_threads;		// For parallel matching
+		size_t			_parallelfrom;	// Population size it starts at
+		vector<ClassifierList> _chunks;	// Matched in each chunk of population
+		MatchIndex		_index;
+		Duplicates		_duplicates;
+		Votes			_votes;
+		double			_votefitness;	// Average fitness the votes were weighed against
+		double			_fitnesssum;	// Over the population (finite fitness only)...
+		unsigned long	_unbounded;		// Fitness gone infinite (or undefined)
+		unsigned long	_numerositysum;
+		Pool			_pool;
+		Parameters		_params;
+		Profile			_profile;
+		double			_payoff;	// Reward, or discounted payoff (multi-step)
+		bool			_haveprevious;		// Previous action set awaiting payoff (multi-step)
+		Reward			_previousreward;
+		Perception		_previouspercept;	// Reused (so no allocation once warm)
 		Perception		_percept;
+		Bits			_packed;	// Perception as bits (for matching)
+		Perception		_query;		// Perception being predicted (apart from learning)
+		Bits			_querybits;
 		Actions			_actions;
+		map<Action,size_t> _actionindices;
 		Action			_proposed;
+		size_t			_proposedindex;
+
+		// Prediction array (dense by action index, one spare for unknown actions)...
+		vector<double>	_predictions;
+		vector<double>	_fitsums;
+		vector<char>	_proposals;	// Actions in match set (for covering)
 
 		unsigned long   _time;
-		long			_seed;
+		Random			_random;
+		vector<double>	_uniforms;	// Scratch draws (covering and mutation)
+		vector<size_t>	_order;		// Scratch order of rows (fitting)
 		double			_reinforced;
+		Publisher*		_publisher;
+		unsigned long	_publishevery;
 
 		friend class Classifier; // Allow classifier to access its system...
+		friend class XCSModel; // And compiling to read the population
 
 	private:
 
 		// Internal algorithm methods:
 
+		Action decide();
+		Action exploit(const Perception&,double*);
+		void matchQuery(const Perception&);
+		void indexActions();
+		size_t actionIndex(Action);
+		void predictionArray(const ClassifierList&);
+		bool matchParallel(const Bits&,ClassifierList&);
+		template<class F> void fitRows(const F*,const Action*,size_t,size_t,unsigned long,Reward,Reward,double*);
 		void generateMatchset();
 		void selectAction();
+		void take(const Perception&,Action);
 		void generateActionSet();
+		void reinforce(double);
 		void updatePrediction();
 		void updateFitness();
 		void applyGA();
@@ -174,7 +601,13 @@ namespace LCS {
 		void applyMutation(Classifier*);
 		void insertIntoPopulation(Classifier*);
 		void deleteFromPopulation();
-		double deletionVote(Classifier*,double);
+		void addToPopulation(Classifier*);
+		void removeFromPopulation(Classifier*);
+		double deletionVote(unsigned long,double);
+		void revote(unsigned long);
+		void revoteAll();
+		void tallyFitness(double,long);
+		void adjustNumerosity(Classifier*,long);
 		void doActionSetSubsumption();
 		bool couldSubsume(Classifier*);
 		long countGenerality(Classifier*);
@@ -183,12 +616,8 @@ namespace LCS {
 
 		// Utility methods:
 
-		double drand();
+		static void pack(const Perception&,Bits&);
 
-#ifdef TEST
-	public:
-					void test();
-#endif
 	};
 
 } // End namespace LCS
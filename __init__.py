@@ -1 +1 @@
-from xcs import xcs 
+from xcs import xcs, model, multiplexer, parity, table, maze, ensemble, sweep 
@@ -6,7 +6,8 @@ setup(
   name='pylcs',
   description='Python Learning Classifier System',
   ext_modules=[
-    Extension("xcs", ["xcs.pyx", "LCS_XCS.cpp"],language="c++",)
+    Extension("xcs", ["xcs.pyx", "LCS_XCS.cpp", "LCS_Environment.cpp", "LCS_Model.cpp", "LCS_Threads.cpp", "LCS_Sweep.cpp", "LCS_Ensemble.cpp", "LCS_Async.cpp", "LCS_Stream.cpp"],language="c++",
+      define_macros=[('LCS_PROFILE',None)],) # Phase timings (switched on with doProfiling)
   ],
   cmdclass = {'build_ext': build_ext}
 )
@@ -1,10 +1,63 @@
 # STL vector
 from libcpp.vector cimport vector
+from libcpp.string cimport string
+from libcpp.map cimport map
+from libcpp.pair cimport pair
+from libc.stdint cimport uint64_t
+from cython.operator cimport dereference as deref
+
+import numpy as np
+
+# Perceptions in a batch may be bytes or ints
+ctypedef fused feature_t:
+	unsigned char
+	int
+
+###############################################################################
+
+# File streams (for text load and save)
+cdef extern from "<iostream>" namespace "std":
+	cdef cppclass istream:
+		pass
+	cdef cppclass ostream:
+		pass
+
+cdef extern from "<fstream>" namespace "std":
+	cdef cppclass ifstream(istream):
+		ifstream(const char*)
+		bint is_open()
+	cdef cppclass ofstream(ostream):
+		ofstream(const char*)
+		bint is_open()
 
 ###############################################################################
 
 
 # namespace
+cdef extern from "LCS_Environment.h" namespace "LCS":
+
+	cdef cppclass Environment:
+		const vector[int]& perceive()
+		long act(long)
+		bint done()
+
+	cdef cppclass Multiplexer(Environment):
+		Multiplexer(size_t,long,long,long)
+
+	cdef cppclass Parity(Environment):
+		Parity(size_t,long,long,long)
+
+	cdef cppclass Table(Environment):
+		Table(const int*,const long*,size_t,size_t,long,long,long)
+
+	cdef cppclass Maze(Environment):
+		Maze(const string&,long,long,size_t)
+		unsigned long episodes()
+		unsigned long moves()
+		size_t width()
+		size_t height()
+		bint valid()
+
 cdef extern from "LCS_XCS.h" namespace "LCS":
 
 	cdef cppclass XCS: 
@@ -27,10 +80,39 @@ cdef extern from "LCS_XCS.h" namespace "LCS":
 		long   THETASUB # GA subsumption threshold
 		long   THETAACT # Minimum actions in matchset before covering.
 		# Methods	
+		void load(istream&)
+		void save(ostream&)
+		bint loadSnapshot(const string&)
+		bint saveSnapshot(const string&)
 		long act(vector[int])
 		void update(long)
+		void update(long,bint)
+		void multiStepOn()
+		void multiStepOff()
+		long act(const vector[int]&,uint64_t&)
+		bint update(uint64_t,long)
+		size_t updateMany(const uint64_t*,const long*,size_t) nogil
+		void ticketCapacity(size_t)
+		bint replayOn(size_t,bint)
+		void replayOff()
+		void remember(const int*,const long*,const long*,size_t,size_t) nogil
+		void remember(const unsigned char*,const long*,const long*,size_t,size_t) nogil
+		void replay(size_t,size_t,bint) nogil
+		size_t replaySize()
+		size_t ticketsOutstanding()
+		void step(Environment&)
+		void train(Environment&,unsigned long,unsigned long,vector[double]*,vector[long]*) nogil
+		void actBatch(const int*,size_t,size_t,long*,double*) nogil
+		void actBatch(const unsigned char*,size_t,size_t,long*,double*) nogil
+		void predictBatch(const int*,size_t,size_t,long*,double*) nogil
+		void predictBatch(const unsigned char*,size_t,size_t,long*,double*) nogil
+		void fit(const int*,const long*,size_t,size_t,unsigned long,long,long,double*) nogil
+		void fit(const unsigned char*,const long*,size_t,size_t,unsigned long,long,long,double*) nogil
 
 		long populationSize()
+		unsigned long classifiersLive()
+		unsigned long classifiersAllocated()
+		unsigned long classifiersRecycled()
 		double internalPerformance()
 		unsigned long currentTime()
 	
@@ -38,103 +120,765 @@ cdef extern from "LCS_XCS.h" namespace "LCS":
 		void subsumptionOff()
 		void learningOn()
 		void learningOff()
+		void matchIndexOn()
+		void matchIndexOff()
+		void parallelMatchOn(size_t,size_t)
+		void parallelMatchOff()
+		void profilingOn()
+		void profilingOff()
+		void seed(long,unsigned long)
+		map[string,double] profile()
+		vector[unsigned long] latencyHistogram()
+		void profileClear()
+		void publish()
+		void publishEvery(unsigned long)
+		Publisher& publisher() nogil
+
+cdef extern from "LCS_Async.h" namespace "LCS":
+
+	cdef cppclass Stats "LCS::AsyncLearner::Stats":
+		size_t depth
+		size_t capacity
+		unsigned long enqueued
+		unsigned long learned
+		unsigned long dropped
+		double lag
+		double maxlag
+		unsigned long version
+
+	cdef enum Backpressure "LCS::AsyncLearner::Backpressure":
+		BLOCK "LCS::AsyncLearner::BLOCK"
+		DROP "LCS::AsyncLearner::DROP"
+
+	cdef cppclass AsyncLearner:
+		AsyncLearner(XCS&,size_t,Backpressure,unsigned long)
+		long act(const vector[int]&)
+		bint update(long,bint) nogil
+		void flush() nogil
+		Stats stats()
+
+cdef extern from "LCS_Ensemble.h" namespace "LCS":
+
+	cdef cppclass XCSEnsemble:
+		XCSEnsemble(vector[long],size_t,long,size_t)
+		size_t size()
+		XCS& member(size_t)
+		bint step(Environment&) nogil
+		bint train(Environment&,unsigned long,unsigned long,vector[double]*,vector[long]*) nogil
+		void fit(const int*,const long*,size_t,size_t,unsigned long,long,long,double*) nogil
+		void fit(const unsigned char*,const long*,size_t,size_t,unsigned long,long,long,double*) nogil
+		long predict(const vector[int]&,double*) nogil
+		void predictBatch(const int*,size_t,size_t,long*,double*) nogil
+		void predictBatch(const unsigned char*,size_t,size_t,long*,double*) nogil
+
+cdef extern from "LCS_Sweep.h" namespace "LCS":
+
+	cdef cppclass Run "LCS::Sweep::Run":
+		vector[pair[string,double]] settings
+		long seed
+		double performance
+		long population
+		double seconds
+		vector[double] performances
+		vector[long] populations
+
+	cdef cppclass Sweep:
+		Sweep(vector[long],size_t)
+		void add(const vector[pair[string,double]]&,long)
+		void grid(const vector[string]&,const vector[vector[double]]&,const vector[long]&)
+		bint run(const Environment&,unsigned long,unsigned long) nogil
+		vector[Run]& runs()
+
+cdef extern from "LCS_Stream.h" namespace "LCS":
+
+	cdef enum Format "LCS::RowStream::Format":
+		BINARY "LCS::RowStream::BINARY"
+		CSV "LCS::RowStream::CSV"
+
+	cdef cppclass RowStream:
+		RowStream(const string&,Format,size_t)
+		bint valid()
+		size_t width()
+		bint feed(XCS&,unsigned long,long,long,double*) nogil
+
+cdef extern from "LCS_Stream.h" namespace "LCS::RowStream":
+
+	bint writeRows "LCS::RowStream::write"(const string&,const int*,const long*,size_t,size_t)
+	bint writeRows "LCS::RowStream::write"(const string&,const unsigned char*,const long*,size_t,size_t)
+
+cdef extern from "LCS_Model.h" namespace "LCS":
+
+	cdef cppclass XCSModel:
+		XCSModel(XCS&)
+		long predict(const vector[int]&,double*)
+		void predictBatch(const int*,size_t,size_t,long*,double*) nogil
+		void predictBatch(const unsigned char*,size_t,size_t,long*,double*) nogil
+		size_t size()
+		size_t length()
+
+	cdef cppclass Publisher:
+		unsigned long version()
+
+	cdef cppclass Reader "LCS::Publisher::Reader":
+		Reader(Publisher&) nogil
+		XCSModel& acquire() nogil
+		void release() nogil
 
 ###############################################################################
 
 cdef class xcs:
 	cdef XCS *thisptr      # hold a C++ instance which we're wrapping
+	cdef AsyncLearner *learner	# learning on a thread of its own (when async)
 	
 	def __cinit__(self,actions):
 		self.thisptr = new XCS(actions)
+		self.learner = NULL
 
 	def __dealloc__(self):
+		del self.learner
 		del self.thisptr
+
+	cdef XCS* owned(self) except NULL:
+		"""The system, unless it belongs to the async learner (raises until async_off)"""
+		if self.learner:
+			raise RuntimeError("the async learner has the system until async_off")
+		return self.thisptr
 	
 	def time(self):
-		return self.thisptr.currentTime()
+		return self.owned().currentTime()
 	
 	def perf(self):
-		return self.thisptr.internalPerformance()
+		return self.owned().internalPerformance()
 	
 	def size(self):
-		return self.thisptr.populationSize()
+		return self.owned().populationSize()
+
+	def pool(self):
+		"""Classifier pool counters (live, allocated in slabs, and recycled from the free list)"""
+		return {'live': self.owned().classifiersLive(),
+		        'allocated': self.owned().classifiersAllocated(),
+		        'recycled': self.owned().classifiersRecycled()}
 	
+	def load(self,path):
+		"""Replace population with one saved as text"""
+		cdef ifstream* f = new ifstream(path.encode())
+		try:
+			if not f.is_open():
+				raise IOError("Cannot open %s" % path)
+			self.owned().load(deref(f))
+		finally:
+			del f
+
+	def save(self,path):
+		"""Save population as text (a classifier per line)"""
+		cdef ofstream* f = new ofstream(path.encode())
+		try:
+			if not f.is_open():
+				raise IOError("Cannot open %s" % path)
+			self.owned().save(deref(f))
+		finally:
+			del f
+
+	def load_snapshot(self,path):
+		"""Replace population and state with a binary snapshot (memory mapped)"""
+		if not self.owned().loadSnapshot(path.encode()):
+			raise IOError("Cannot load snapshot %s" % path)
+
+	def save_snapshot(self,path):
+		"""Save population and state as a binary snapshot"""
+		if not self.owned().saveSnapshot(path.encode()):
+			raise IOError("Cannot save snapshot %s" % path)
+
 	def act(self,perception):
 		cdef vector[int] vect = list(perception)
+		if self.learner:
+			return self.learner.act(vect)
 		return self.thisptr.act(vect)
 
-	def reward(self,amount):
-		self.thisptr.update(amount)
+	def reward(self,amount,done=True):
+		"""Reward the last act (multi-step, done is whether the problem ended with it)"""
+		cdef long r = amount
+		cdef bint queued, d = done
+		if self.learner:
+			with nogil:
+				queued = self.learner.update(r,d)
+			return queued
+		self.thisptr.update(r,<bint>done)
+
+	def act_ticket(self,perception):
+		"""Act, returning the action and a ticket to reward it by later, in any order (ticket 0 when all are outstanding)"""
+		cdef vector[int] vect = list(perception)
+		cdef uint64_t ticket = 0
+		cdef long action = self.owned().act(vect,ticket)
+		return action,ticket
+
+	def update(self,ticket,amount):
+		"""Reward a ticket (False if unknown or already rewarded)"""
+		return self.owned().update(<uint64_t>ticket,<long>amount)
+
+	def update_many(self,tickets,rewards):
+		"""Reward a batch of tickets (returns how many were known)"""
+		cdef XCS* system = self.owned()
+		cdef uint64_t[::1] t = np.ascontiguousarray(tickets,dtype=np.uint64)
+		cdef long[::1] r = np.ascontiguousarray(rewards,dtype='l')
+		if t.shape[0]!=r.shape[0]:
+			raise ValueError("need a reward for every ticket")
+		cdef size_t n = t.shape[0], updated = 0
+		if n>0:
+			with nogil:
+				updated = system.updateMany(&t[0],&r[0],n)
+		return updated
+
+	def ticket_capacity(self,capacity):
+		"""Tickets outstanding at most (any outstanding are dropped)"""
+		self.owned().ticketCapacity(capacity)
+
+	def tickets_outstanding(self):
+		return self.owned().ticketsOutstanding()
+
+	def replay_on(self,capacity,live=True):
+		"""Keep the latest so many experiences for replay (recording every reward too, if live - not multi-step)"""
+		if not self.owned().replayOn(capacity,live):
+			raise ValueError("multi-step rewards are not recorded for replay (live=False, and remember them)")
+
+	def replay_off(self):
+		self.owned().replayOff()
+
+	def remember(self,feature_t[:,::1] X,actions,rewards):
+		"""Load logged experiences for replay - perceptions (2-D uint8/int32), the actions taken and their rewards"""
+		cdef XCS* system = self.owned()
+		cdef size_t n = X.shape[0], width = X.shape[1]
+		cdef long[::1] a = np.ascontiguousarray(actions,dtype='l')
+		cdef long[::1] r = np.ascontiguousarray(rewards,dtype='l')
+		if a.shape[0]!=n or r.shape[0]!=n:
+			raise ValueError("need an action and reward for every row")
+		if n>0 and width>0:
+			with nogil:
+				system.remember(&X[0,0],&a[0],&r[0],n,width)
+
+	def replay(self,batch_size,iterations=1,prioritized=False):
+		"""Learn again from so many batches of experiences drawn at random (or by how badly they are predicted)"""
+		cdef XCS* system = self.owned()
+		cdef size_t b = batch_size, i = iterations
+		cdef bint p = prioritized
+		with nogil:
+			system.replay(b,i,p)
+
+	def replay_size(self):
+		return self.owned().replaySize()
+
+	def async_on(self,capacity=4096,block=True,publish=1000):
+		"""Learn on a thread of its own: act uses the latest published model (exploring with EPSILON) and reward
+		only queues the experience (waiting for room when the queue is full if block, else dropping it).
+		Only act, reward (done carried through the queue), serve, published and async_* until async_off - the rest raise"""
+		if not self.learner:
+			self.learner = new AsyncLearner(deref(self.thisptr),capacity,BLOCK if block else DROP,publish)
+
+	def async_off(self):
+		"""Learn whatever is queued, then back to learning on the calling thread"""
+		if self.learner:
+			with nogil:
+				self.learner.flush()
+			del self.learner
+			self.learner = NULL
+
+	def async_stats(self):
+		"""Queue depth, counts, and lag (seconds from queueing to learning) of the async learner"""
+		if not self.learner:
+			return None
+		cdef Stats s = self.learner.stats()
+		return {'depth': s.depth, 'capacity': s.capacity, 'enqueued': s.enqueued, 'learned': s.learned,
+		        'dropped': s.dropped, 'lag': s.lag, 'maxlag': s.maxlag, 'published': s.version}
+
+	def step(self,environment env not None):
+		"""One step against a native environment (perceive, act and learn)"""
+		self.owned().step(deref(env.native()))
+
+	def train(self,environment env not None,steps,every=0):
+		"""Run steps against a native environment without returning to Python (releasing the GIL).
+		Returns time, performance (fraction rewarded over each interval) and population size every so many steps (default a hundred samples)"""
+		cdef XCS* system = self.owned()
+		cdef Environment* native = env.native()
+		cdef unsigned long n = steps
+		cdef unsigned long e = every if every else max(steps//100,1)
+		cdef unsigned long start = system.currentTime()
+		cdef vector[double] performance
+		cdef vector[long] population
+		with nogil:
+			system.train(deref(native),n,e,&performance,&population)
+		return {'time': np.arange(1,performance.size()+1,dtype=np.uint64)*e + start,
+		        'performance': np.array(performance,dtype=np.float64),
+		        'population': np.array(population,dtype='l')}
+
+	def compile(self):
+		"""Frozen copy of the population for serving (exploit only, safe to share between threads)"""
+		return model(self)
+
+	def publish(self):
+		"""Publish the population as it is now to readers (see serve)"""
+		self.owned().publish()
+
+	def publish_every(self,steps):
+		"""Publish automatically every so many steps (zero = only when asked)"""
+		self.owned().publishEvery(steps)
+
+	def published(self):
+		return self.thisptr.publisher().version()
+
+	def serve(self,perception):
+		"""Predict from the latest published model (safe from any thread while another learns)"""
+		return self.serve_batch(np.asarray([list(perception)],dtype=np.int32))[0]
+
+	def serve_batch(self,feature_t[:,::1] X,values=False):
+		"""Predict every row of a 2-D uint8/int32 array from the latest published model (releasing the GIL)"""
+		cdef size_t n = X.shape[0], width = X.shape[1]
+		actions = np.empty(n,dtype='l')
+		predictions = np.empty(n if values else 0,dtype=np.float64)
+		cdef long[::1] a = actions
+		cdef double[::1] p = predictions
+		cdef double* pp = &p[0] if values and n>0 else NULL
+		cdef Reader* reader
+		if n>0:
+			with nogil:
+				reader = new Reader(self.thisptr.publisher())
+				reader.acquire().predictBatch(&X[0,0],n,width,&a[0],pp)
+				reader.release()
+				del reader
+		return (actions,predictions) if values else actions
+
+	def act_batch(self,feature_t[:,::1] X,values=False):
+		"""Act on every row of a 2-D uint8/int32 array (returns actions, and predictions if values)"""
+		cdef XCS* system = self.owned()
+		cdef size_t n = X.shape[0], width = X.shape[1]
+		actions = np.empty(n,dtype='l')
+		predictions = np.empty(n if values else 0,dtype=np.float64)
+		cdef long[::1] a = actions
+		cdef double[::1] p = predictions
+		cdef double* pp = &p[0] if values and n>0 else NULL
+		if n>0 and width>0:
+			with nogil:
+				system.actBatch(&X[0,0],n,width,&a[0],pp)
+		return (actions,predictions) if values else actions
+
+	def predict_batch(self,feature_t[:,::1] X,values=False):
+		"""Exploit only (no covering or learning) on every row of a 2-D uint8/int32 array"""
+		cdef XCS* system = self.owned()
+		cdef size_t n = X.shape[0], width = X.shape[1]
+		actions = np.empty(n,dtype='l')
+		predictions = np.empty(n if values else 0,dtype=np.float64)
+		cdef long[::1] a = actions
+		cdef double[::1] p = predictions
+		cdef double* pp = &p[0] if values and n>0 else NULL
+		if n>0 and width>0:
+			with nogil:
+				system.predictBatch(&X[0,0],n,width,&a[0],pp)
+		return (actions,predictions) if values else actions
+
+	def fit(self,feature_t[:,::1] X,y,epochs=1,reward_correct=1000,reward_wrong=0):
+		"""Supervised learning over a 2-D uint8/int32 array and its labels (shuffled each epoch, returns accuracy per epoch)"""
+		cdef XCS* system = self.owned()
+		cdef size_t n = X.shape[0], width = X.shape[1]
+		cdef long[::1] labels = np.ascontiguousarray(y,dtype='l')
+		if labels.shape[0]!=n:
+			raise ValueError("need a label for every row")
+		cdef unsigned long e = epochs
+		cdef long correct = reward_correct, wrong = reward_wrong
+		accuracy = np.zeros(e,dtype=np.float64)
+		cdef double[::1] acc = accuracy
+		if n>0 and width>0 and e>0:
+			with nogil:
+				system.fit(&X[0,0],&labels[0],n,width,e,correct,wrong,&acc[0])
+		return accuracy
+
+	def train_file(self,path,format='binary',epochs=1,reward_correct=1000,reward_wrong=0,chunk=65536):
+		"""Supervised learning from a file of rows too large for memory - 'binary' (see save_rows,
+		memory mapped) or 'csv' (label last, a header line skipped) - parsed a chunk ahead on a thread
+		of its own (GIL released, rows shuffled within chunks, returns accuracy per epoch)"""
+		cdef XCS* system = self.owned()
+		if format not in ('binary','csv'):
+			raise ValueError("format is 'binary' or 'csv'")
+		cdef RowStream* stream = new RowStream(path.encode(),BINARY if format=='binary' else CSV,chunk)
+		cdef unsigned long e = epochs
+		cdef long correct = reward_correct, wrong = reward_wrong
+		cdef bint ok
+		accuracy = np.zeros(e,dtype=np.float64)
+		cdef double[::1] acc = accuracy
+		try:
+			if not stream.valid():
+				raise IOError("Cannot read rows from %s" % path)
+			if e>0:
+				with nogil:
+					ok = stream.feed(deref(system),e,correct,wrong,&acc[0])
+				if not ok:
+					raise IOError("Bad row in %s" % path)
+			return accuracy
+		finally:
+			del stream
 
 	def doSubsumption(self,yes):
 		if yes:
-			self.thisptr.subsumptionOn()
+			self.owned().subsumptionOn()
 		else:
-			self.thisptr.subsumptionOff()
+			self.owned().subsumptionOff()
   
 	def doLearning(self,yes):
 		if yes:
-			self.thisptr.learningOn()
+			self.owned().learningOn()
+		else:
+			self.owned().learningOff()
+
+	def doMultiStep(self,yes):
+		"""Pay each action set its reward plus GAMMA times the best prediction of the step after (for mazes)"""
+		if yes:
+			self.owned().multiStepOn()
+		else:
+			self.owned().multiStepOff()
+
+	def doMatchIndex(self,yes):
+		if yes:
+			self.owned().matchIndexOn()
+		else:
+			self.owned().matchIndexOff()
+
+	def doParallelMatch(self,yes,threads=0,threshold=50000):
+		if yes:
+			self.owned().parallelMatchOn(threads,threshold)
+		else:
+			self.owned().parallelMatchOff()
+
+	def doProfiling(self,yes):
+		if yes:
+			self.owned().profilingOn()
 		else:
-			self.thisptr.learningOff()
+			self.owned().profilingOff()
+
+	def seed(self,value,stream=0):
+		"""Seed the random number generator (runs with the same seed and stream repeat exactly, different streams are independent)"""
+		self.owned().seed(value,stream)
+
+	def profile(self):
+		"""Cumulative nanoseconds and calls per phase, and event counts"""
+		return {k.decode(): v for k,v in self.owned().profile()}
+
+	def latency_histogram(self):
+		"""Decisions counted by log2 of nanoseconds taken (index = bucket)"""
+		return self.owned().latencyHistogram()
+
+	def profile_clear(self):
+		self.owned().profileClear()
 
 	property BETA:
-		def __get__(self): return self.thisptr.BETA
-		def __set__(self,beta): self.thisptr.BETA = beta
+		def __get__(self): return self.owned().BETA
+		def __set__(self,beta): self.owned().BETA = beta
 	
 	property GAMMA:
-		def __get__(self): return self.thisptr.GAMMA
-		def __set__(self,gamma): self.thisptr.GAMMA = gamma 
+		def __get__(self): return self.owned().GAMMA
+		def __set__(self,gamma): self.owned().GAMMA = gamma 
 	
 	property ALPHA:
-		def __get__(self): return self.thisptr.ALPHA
-		def __set__(self,alpha): self.thisptr.ALPHA = alpha 
+		def __get__(self): return self.owned().ALPHA
+		def __set__(self,alpha): self.owned().ALPHA = alpha 
 	
 	property ERROR:
-		def __get__(self): return self.thisptr.ERROR
-		def __set__(self,error): self.thisptr.ERROR = error 
+		def __get__(self): return self.owned().ERROR
+		def __set__(self,error): self.owned().ERROR = error 
 	
 	property VAL:
-		def __get__(self): return self.thisptr.VAL
-		def __set__(self,val): self.thisptr.VAL = val 
+		def __get__(self): return self.owned().VAL
+		def __set__(self,val): self.owned().VAL = val 
 	
 	property EPSILON:
-		def __get__(self): return self.thisptr.EPSILON
-		def __set__(self,epsilon): self.thisptr.EPSILON = epsilon 
+		def __get__(self): return self.owned().EPSILON
+		def __set__(self,epsilon): self.owned().EPSILON = epsilon 
 	
 	property N:
-		def __get__(self): return self.thisptr.N
-		def __set__(self,n): self.thisptr.N = n 
+		def __get__(self): return self.owned().N
+		def __set__(self,n): self.owned().N = n 
 	
 	property MU: 
-		def __get__(self): return self.thisptr.MU
-		def __set__(self,mu): self.thisptr.MU = mu 
+		def __get__(self): return self.owned().MU
+		def __set__(self,mu): self.owned().MU = mu 
 	
 	property XU: 
-		def __get__(self): return self.thisptr.XU
-		def __set__(self,xu): self.thisptr.XU = xu 
+		def __get__(self): return self.owned().XU
+		def __set__(self,xu): self.owned().XU = xu 
 	
 	property SIGMA: 
-		def __get__(self): return self.thisptr.SIGMA
-		def __set__(self,sigma): self.thisptr.SIGMA = sigma 
+		def __get__(self): return self.owned().SIGMA
+		def __set__(self,sigma): self.owned().SIGMA = sigma 
 	
 	property PHASH: 
-		def __get__(self): return self.thisptr.PHASH
-		def __set__(self,phash): self.thisptr.PHASH = phash 
+		def __get__(self): return self.owned().PHASH
+		def __set__(self,phash): self.owned().PHASH = phash 
 	
 	property THETAGA: 
-		def __get__(self): return self.thisptr.THETAGA
-		def __set__(self,thetaga): self.thisptr.THETAGA = thetaga 
+		def __get__(self): return self.owned().THETAGA
+		def __set__(self,thetaga): self.owned().THETAGA = thetaga 
 	
 	property THETADEL: 
-		def __get__(self): return self.thisptr.THETADEL
-		def __set__(self,thetadel): self.thisptr.THETADEL= thetadel 
+		def __get__(self): return self.owned().THETADEL
+		def __set__(self,thetadel): self.owned().THETADEL= thetadel 
 	
 	property THETASUB: 
-		def __get__(self): return self.thisptr.THETASUB
-		def __set__(self,thetasub): self.thisptr.THETASUB = thetasub
+		def __get__(self): return self.owned().THETASUB
+		def __set__(self,thetasub): self.owned().THETASUB = thetasub
 	
 	property THETAACT: 
-		def __get__(self): return self.thisptr.THETAACT
-		def __set__(self,thetaact): self.thisptr.THETAACT = thetaact 
+		def __get__(self): return self.owned().THETAACT
+		def __set__(self,thetaact): self.owned().THETAACT = thetaact 
 	
+
+###############################################################################
+
+# Native environments (for step and train)
+
+cdef class environment:
+	cdef Environment *thisptr
+
+	def __cinit__(self,*args,**kwargs):
+		if type(self) is environment:
+			raise TypeError("environment is the base of native environments (multiplexer, parity, table or maze)")
+		self.thisptr = NULL
+
+	def __dealloc__(self):
+		del self.thisptr
+
+	cdef Environment* native(self) except NULL:
+		"""The native environment (raises if there is none, as for a subclass defined in Python)"""
+		if self.thisptr==NULL:
+			raise ValueError("not a native environment (multiplexer, parity, table or maze)")
+		return self.thisptr
+
+	def perceive(self):
+		return list(self.native().perceive())
+
+	def act(self,action):
+		return self.native().act(action)
+
+	def done(self):
+		return self.native().done()
+
+cdef class multiplexer(environment):
+	"""Multiplexer of so many address bits (random perceptions)"""
+
+	def __cinit__(self,address,seed=1,correct=1000,wrong=0):
+		self.thisptr = new Multiplexer(address,seed,correct,wrong)
+
+cdef class parity(environment):
+	"""Even parity of so many bits (random perceptions)"""
+
+	def __cinit__(self,bits,seed=1,correct=1000,wrong=0):
+		self.thisptr = new Parity(bits,seed,correct,wrong)
+
+cdef class table(environment):
+	"""Rows of a 2-D dataset X drawn at random, rewarding actions equal to their labels y (data is copied)"""
+
+	def __cinit__(self,X,y,seed=1,correct=1000,wrong=0):
+		cdef int[:,::1] rows = np.ascontiguousarray(X,dtype=np.int32)
+		cdef long[::1] labels = np.ascontiguousarray(y,dtype='l')
+		if rows.shape[0]==0 or rows.shape[1]==0 or rows.shape[0]!=labels.shape[0]:
+			raise ValueError("need a label for every row (and some rows and columns)")
+		self.thisptr = new Table(&rows[0,0],&labels[0],rows.shape[0],rows.shape[1],seed,correct,wrong)
+
+cdef class maze(environment):
+	"""Maze or woods (rows of '.', 'O' obstacle and 'F' food, wrapping around - or "woods1" or "maze4"),
+	eight neighbours seen as two bits each, actions 0-7 move from north clockwise, food pays and starts afresh"""
+
+	def __cinit__(self,layout="woods1",seed=1,food=1000,limit=50):
+		cdef Maze* m = new Maze(layout.encode(),seed,food,limit)
+		if not m.valid():
+			del m
+			raise ValueError("maze needs an empty cell")
+		self.thisptr = m
+
+	def episodes(self):
+		return (<Maze*>self.thisptr).episodes()
+
+	def steps_to_food(self):
+		"""Mean steps taken to find food so far"""
+		cdef Maze* m = <Maze*>self.thisptr
+		return m.moves()/float(m.episodes()) if m.episodes() else 0.0
+
+###############################################################################
+
+# Frozen model (from xcs.compile)
+
+cdef class model:
+	cdef XCSModel *thisptr
+
+	def __cinit__(self,xcs learner):
+		self.thisptr = new XCSModel(deref(learner.owned()))
+
+	def __dealloc__(self):
+		del self.thisptr
+
+	def size(self):
+		return self.thisptr.size()
+
+	def predict(self,perception):
+		cdef vector[int] vect = list(perception)
+		return self.thisptr.predict(vect,NULL)
+
+	def predict_batch(self,feature_t[:,::1] X,values=False):
+		"""Predict every row of a 2-D uint8/int32 array (releasing the GIL, so threads can share the model)"""
+		cdef size_t n = X.shape[0], width = X.shape[1]
+		actions = np.empty(n,dtype='l')
+		predictions = np.empty(n if values else 0,dtype=np.float64)
+		cdef long[::1] a = actions
+		cdef double[::1] p = predictions
+		cdef double* pp = &p[0] if values and n>0 else NULL
+		if n>0:
+			with nogil:
+				self.thisptr.predictBatch(&X[0,0],n,width,&a[0],pp)
+		return (actions,predictions) if values else actions
+
+###############################################################################
+
+# Ensemble (members seeded apart, learning and deciding side by side)
+
+cdef class ensemble:
+	"""So many systems learning the same stream on threads, deciding by fitness weighted vote"""
+	cdef XCSEnsemble *thisptr
+
+	def __cinit__(self,actions,members=5,seed=1,threads=0):
+		self.thisptr = new XCSEnsemble(actions,members,seed,threads)
+
+	def __dealloc__(self):
+		del self.thisptr
+
+	def members(self):
+		return self.thisptr.size()
+
+	def size(self):
+		"""Population size of every member"""
+		return [self.thisptr.member(m).populationSize() for m in range(self.thisptr.size())]
+
+	def step(self,environment env not None):
+		"""One step against a native single-step environment (every member acts on it)"""
+		cdef Environment* native = env.native()
+		cdef bint ok
+		with nogil:
+			ok = self.thisptr.step(deref(native))
+		if not ok:
+			raise ValueError("an ensemble learns single-step environments only (each member would move a multi-step one)")
+
+	def train(self,environment env not None,steps,every=0):
+		"""As xcs.train, single-step environments only (performance is the fraction of members' actions rewarded, population summed over members)"""
+		cdef Environment* native = env.native()
+		cdef unsigned long n = steps
+		cdef unsigned long e = every if every else max(steps//100,1)
+		cdef vector[double] performance
+		cdef vector[long] population
+		cdef bint ok
+		with nogil:
+			ok = self.thisptr.train(deref(native),n,e,&performance,&population)
+		if not ok:
+			raise ValueError("an ensemble learns single-step environments only (each member would move a multi-step one)")
+		return {'time': np.arange(1,performance.size()+1,dtype=np.uint64)*e,
+		        'performance': np.array(performance,dtype=np.float64),
+		        'population': np.array(population,dtype='l')}
+
+	def fit(self,feature_t[:,::1] X,y,epochs=1,reward_correct=1000,reward_wrong=0):
+		"""As xcs.fit, every member on the same shuffle (accuracy is the members' average)"""
+		cdef size_t n = X.shape[0], width = X.shape[1]
+		cdef long[::1] labels = np.ascontiguousarray(y,dtype='l')
+		if labels.shape[0]!=n:
+			raise ValueError("need a label for every row")
+		cdef unsigned long e = epochs
+		cdef long correct = reward_correct, wrong = reward_wrong
+		accuracy = np.zeros(e,dtype=np.float64)
+		cdef double[::1] acc = accuracy
+		if n>0 and width>0 and e>0:
+			with nogil:
+				self.thisptr.fit(&X[0,0],&labels[0],n,width,e,correct,wrong,&acc[0])
+		return accuracy
+
+	def predict(self,perception):
+		cdef vector[int] vect = list(perception)
+		cdef long action
+		with nogil:
+			action = self.thisptr.predict(vect,NULL)
+		return action
+
+	def predict_batch(self,feature_t[:,::1] X,values=False):
+		"""Predict every row of a 2-D uint8/int32 array (members vote in parallel, GIL released)"""
+		cdef size_t n = X.shape[0], width = X.shape[1]
+		actions = np.empty(n,dtype='l')
+		predictions = np.empty(n if values else 0,dtype=np.float64)
+		cdef long[::1] a = actions
+		cdef double[::1] p = predictions
+		cdef double* pp = &p[0] if values and n>0 else NULL
+		if n>0:
+			with nogil:
+				self.thisptr.predictBatch(&X[0,0],n,width,&a[0],pp)
+		return (actions,predictions) if values else actions
+
+###############################################################################
+
+# Sweep (many independent runs at once)
+
+def sweep(actions,environment env not None,steps,grid=None,settings=None,seeds=(1,),every=0,threads=0):
+	"""Run a system for every setting of parameters - a grid ({'BETA': [0.1,0.2], ...}, all
+	combinations) and/or a list of settings ([{'N': 400}, ...]) - with every seed, each on its own
+	copy of the environment, spread over threads (zero = as many as cores, GIL released).
+	Returns a result per run: settings, seed, final performance, population and seconds (and
+	performance and population every so many steps, if asked)"""
+	cdef Environment* native = env.native()
+	cdef Sweep* runner = new Sweep(actions,threads)
+	cdef vector[string] names
+	cdef vector[vector[double]] values
+	cdef vector[pair[string,double]] one
+	cdef unsigned long n = steps, e = every
+	cdef bint ok
+	cdef Run run
+	try:
+		if grid:
+			for name in grid:
+				names.push_back(name.encode())
+				values.push_back([float(v) for v in grid[name]])
+			runner.grid(names,values,list(seeds))
+		for setting in (settings or []):
+			one = [(name.encode(),float(value)) for name,value in setting.items()]
+			for seed in seeds:
+				runner.add(one,seed)
+		if not grid and not settings:
+			for seed in seeds:
+				runner.add(one,seed)
+		with nogil:
+			ok = runner.run(deref(native),n,e)
+		if not ok:
+			raise ValueError("Unknown parameter in sweep (or a fraction where a whole number is needed)")
+		results = []
+		for r in range(runner.runs().size()):
+			run = runner.runs()[r]
+			results.append({'settings': {k.decode(): v for k,v in run.settings},
+			                'seed': run.seed,
+			                'performance': run.performance,
+			                'population': run.population,
+			                'seconds': run.seconds,
+			                'performances': np.array(run.performances,dtype=np.float64),
+			                'populations': np.array(run.populations,dtype='l')})
+		return results
+	finally:
+		del runner
+
+###############################################################################
+
+# Rows to a file (for xcs.train_file)
+
+def save_rows(path,feature_t[:,::1] X,y):
+	"""Write a 2-D uint8/int32 array and its labels as a binary file of rows (nonzero features as set bits)"""
+	cdef size_t n = X.shape[0], width = X.shape[1]
+	cdef long[::1] labels = np.ascontiguousarray(y,dtype='l')
+	if labels.shape[0]!=n:
+		raise ValueError("need a label for every row")
+	if width==0:
+		raise ValueError("need at least one feature")
+	cdef string name = path.encode()
+	cdef feature_t* rows = NULL
+	cdef long* lp = NULL
+	if n>0:
+		rows = &X[0,0]
+		lp = &labels[0]
+	if not writeRows(name,rows,lp,n,width):
+		raise IOError("Cannot write rows to %s" % path)